@@ -2,73 +2,268 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MAX_WORD_LEN 100
-#define MAX_WORDS 10000
+// Header of the binary result files written by every counter (see
+// writeResultFile); followed by the count column, count + 1 key offsets and
+// the sorted key blob
+typedef struct {
+    char magic[4];          // "WCB1"
+    uint32_t version;
+    uint64_t count;
+    uint64_t keyBytes;
+    uint64_t totalTokens;
+} ResultHeader;
 
+// A result file mapped read-only; the columns point straight into the mapping
 typedef struct {
-    char word[MAX_WORD_LEN];
-    int count;
-} WordCount;
+    void* map;
+    size_t mapSize;
+    uint64_t count;
+    uint64_t totalTokens;
+    const uint64_t* counts;
+    const uint64_t* offsets;
+    const char* keys;
+} ResultFile;
 
-int readWordCounts(const char* filename, WordCount* arr, int* size) {
-    FILE* f = fopen(filename, "r");
-    if (!f) {
+int openResult(const char* filename, ResultFile* result) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror(filename);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ResultHeader)) {
+        fprintf(stderr, "%s: not a result file\n", filename);
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
         perror(filename);
         return -1;
     }
 
-    char line[256];
-    int i = 0;
-    while (fgets(line, sizeof(line), f) != NULL) {
-        if (sscanf(line, "%99[^:]: %d", arr[i].word, &arr[i].count) == 2) {
-            i++;
-            if (i >= MAX_WORDS) break;
-        }
+    const ResultHeader* header = map;
+    uint64_t n = header->count;
+    size_t columns = sizeof(ResultHeader) + (n * 2 + 1) * sizeof(uint64_t);
+    if (memcmp(header->magic, "WCB1", 4) != 0 || header->version != 1 ||
+        n > (uint64_t)st.st_size / (2 * sizeof(uint64_t)) || columns + header->keyBytes != (size_t)st.st_size) {
+        fprintf(stderr, "%s: not a result file\n", filename);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    result->map = map;
+    result->mapSize = st.st_size;
+    result->count = n;
+    result->totalTokens = header->totalTokens;
+    result->counts = (const uint64_t*)((const char*)map + sizeof(ResultHeader));
+    result->offsets = result->counts + n;
+    result->keys = (const char*)(result->offsets + n + 1);
+    // Offsets must increase up to keyBytes and every key must end in a NUL
+    // before the next one starts, so keys can be read straight from the map
+    int corrupt = result->offsets[n] != header->keyBytes;
+    for (uint64_t i = 0; i < n && !corrupt; i++) {
+        corrupt = result->offsets[i] >= result->offsets[i + 1] || result->offsets[i + 1] > header->keyBytes ||
+                  result->keys[result->offsets[i + 1] - 1] != '\0';
+    }
+    if (corrupt) {
+        fprintf(stderr, "%s: corrupt key blob\n", filename);
+        munmap(map, st.st_size);
+        return -1;
     }
-    fclose(f);
-    *size = i;
     return 0;
 }
 
-int findWordIndex(WordCount* arr, int size, const char* word) {
-    for (int i = 0; i < size; i++) {
-        if (strcmp(arr[i].word, word) == 0) return i;
+void closeResult(ResultFile* result) {
+    munmap(result->map, result->mapSize);
+}
+
+const char* resultKey(const ResultFile* result, uint64_t i) {
+    return result->keys + result->offsets[i];
+}
+
+// Binary search over the sorted keys; returns the index or -1
+long long findWordIndex(const ResultFile* result, const char* word) {
+    long long lo = 0, hi = (long long)result->count - 1;
+    while (lo <= hi) {
+        long long mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(resultKey(result, mid), word);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
     }
     return -1;
 }
 
-double computeRMSE(WordCount* serial, int serialSize, WordCount* parallel, int parallelSize) {
+double computeRMSE(const ResultFile* serial, const ResultFile* parallel) {
     double mse = 0.0;
-    int n = serialSize;
+    uint64_t n = serial->count;
 
-    for (int i = 0; i < serialSize; i++) {
-        int pIndex = findWordIndex(parallel, parallelSize, serial[i].word);
-        int pCount = (pIndex == -1) ? 0 : parallel[pIndex].count;
-        int diff = serial[i].count - pCount;
+    for (uint64_t i = 0; i < n; i++) {
+        long long pIndex = findWordIndex(parallel, resultKey(serial, i));
+        long long pCount = (pIndex == -1) ? 0 : (long long)parallel->counts[pIndex];
+        double diff = (double)((long long)serial->counts[i] - pCount);
         mse += diff * diff;
     }
 
-    mse /= n;
+    mse /= n ? n : 1;
     return sqrt(mse);
 }
 
-int main() {
-    WordCount serial[MAX_WORDS], openmp[MAX_WORDS], mpi[MAX_WORDS], hybrid[MAX_WORDS];
-    int serialSize, openmpSize, mpiSize, hybridSize;
+// Backends swept by --sweep
+typedef struct {
+    const char* name;
+    const char* program;
+    const char* outputFile;
+    int usesMpi;        // launched through mpirun
+} Backend;
 
-    if (readWordCounts("word_frequencies.txt", serial, &serialSize) < 0) return 1;
-    if (readWordCounts("word_frequencies._output_openmp.txt", openmp, &openmpSize) < 0) return 1;
-    if (readWordCounts("word_frequencies_output_mpi.txt", mpi, &mpiSize) < 0) return 1;
-    if (readWordCounts("final_word_count.txt", hybrid, &hybridSize) < 0) return 1;
+Backend backends[] = {
+    { "OpenMP", "./word_counter_openmp", "word_frequencies_openmp.wcb", 0 },
+    { "MPI", "./word_counter_mpi", "word_frequencies_mpi.wcb", 1 },
+    { "Hybrid", "./word_counter_hybrid", "final_word_count.wcb", 1 },
+};
+#define NUM_BACKENDS (int)(sizeof(backends) / sizeof(backends[0]))
 
-    double rmseOpenMP = computeRMSE(serial, serialSize, openmp, openmpSize);
-    double rmseMPI = computeRMSE(serial, serialSize, mpi, mpiSize);
-    double rmseHybrid = computeRMSE(serial, serialSize, hybrid, hybridSize);
+// Run one backend and return the time it reports, or -1 if it failed
+double runBackend(const Backend* backend, const char* mpirun, int np, double rate) {
+    char command[512];
+    if (backend->usesMpi) {
+        snprintf(command, sizeof(command), "%s -np %d %s --sample=%g", mpirun, np, backend->program, rate);
+    } else {
+        snprintf(command, sizeof(command), "%s --sample=%g", backend->program, rate);
+    }
+    FILE* p = popen(command, "r");
+    if (!p) {
+        perror(command);
+        return -1.0;
+    }
+    // Every backend prints its time as "... Time: <seconds> seconds"; word lines never contain a space
+    char line[256];
+    double seconds = -1.0;
+    while (fgets(line, sizeof(line), p) != NULL) {
+        char* colon = strchr(line, ':');
+        if (colon && strstr(line, " seconds") && seconds < 0.0) {
+            sscanf(colon + 1, "%lf", &seconds);
+        }
+    }
+    if (pclose(p) != 0) {
+        fprintf(stderr, "Command failed: %s\n", command);
+        return -1.0;
+    }
+    return seconds;
+}
+
+// Sweep the sample rate of every backend against the exact serial result and
+// write the speed/accuracy curve to sample_sweep.csv plus a gnuplot script
+int runSweep(const double* rates, int numRates, const char* mpirun, int np) {
+    ResultFile serial, parallel;
+    if (openResult("word_frequencies.wcb", &serial) < 0) {
+        fprintf(stderr, "Run ./word_counter first to produce the exact reference\n");
+        return 1;
+    }
+    long long totalTokens = serial.totalTokens;
+
+    FILE* csv = fopen("sample_sweep.csv", "w");
+    if (!csv) {
+        perror("sample_sweep.csv");
+        closeResult(&serial);
+        return 1;
+    }
+    fprintf(csv, "backend,sample_rate,seconds,tokens_per_second,rmse\n");
+    printf("%-8s %11s %12s %16s %12s\n", "Backend", "Sample rate", "Seconds", "Tokens/second", "RMSE");
+
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+        for (int r = 0; r < numRates; r++) {
+            double seconds = runBackend(&backends[b], mpirun, np, rates[r]);
+            if (seconds < 0.0 || openResult(backends[b].outputFile, &parallel) < 0) {
+                fclose(csv);
+                closeResult(&serial);
+                return 1;
+            }
+            double rmse = computeRMSE(&serial, &parallel);
+            closeResult(&parallel);
+            double throughput = seconds > 0.0 ? totalTokens / seconds : 0.0;
+            printf("%-8s %11g %12.6f %16.0f %12.6f\n", backends[b].name, rates[r], seconds, throughput, rmse);
+            fprintf(csv, "%s,%g,%f,%.0f,%f\n", backends[b].name, rates[r], seconds, throughput, rmse);
+        }
+    }
+    fclose(csv);
+    closeResult(&serial);
+
+    FILE* gp = fopen("sample_sweep.gp", "w");
+    if (gp) {
+        fprintf(gp, "set datafile separator ','\n");
+        fprintf(gp, "set terminal pngcairo size 900,600\n");
+        fprintf(gp, "set output 'sample_sweep.png'\n");
+        fprintf(gp, "set xlabel 'RMSE vs serial'\n");
+        fprintf(gp, "set ylabel 'Tokens per second'\n");
+        fprintf(gp, "set key top right\n");
+        fprintf(gp, "plot ");
+        for (int b = 0; b < NUM_BACKENDS; b++) {
+            fprintf(gp, "%s'sample_sweep.csv' using (stringcolumn(1) eq '%s' ? $5 : 1/0):4 with linespoints title '%s'",
+                    b ? ", \\\n     " : "", backends[b].name, backends[b].name);
+        }
+        fprintf(gp, "\n");
+        fclose(gp);
+    }
+    printf("Sweep saved to 'sample_sweep.csv'; plot it with 'gnuplot sample_sweep.gp'\n");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    ResultFile serial, openmp, mpi, hybrid;
+
+    // --sweep [--rates=R1,R2,...] [--np=N] [--mpirun=CMD]: speed/accuracy curve of the approximate mode
+    int sweep = 0;
+    double rates[32] = { 1.0, 0.5, 0.25, 0.1, 0.05, 0.01 };
+    int numRates = 6;
+    int np = 4;
+    const char* mpirun = "mpirun";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sweep") == 0) {
+            sweep = 1;
+        } else if (strncmp(argv[i], "--rates=", 8) == 0) {
+            numRates = 0;
+            for (char* p = argv[i] + 8; *p && numRates < 32; ) {
+                rates[numRates++] = strtod(p, &p);
+                if (*p == ',') p++;
+                else break;
+            }
+        } else if (strncmp(argv[i], "--np=", 5) == 0) {
+            np = atoi(argv[i] + 5);
+        } else if (strncmp(argv[i], "--mpirun=", 9) == 0) {
+            mpirun = argv[i] + 9;
+        } else {
+            fprintf(stderr, "Usage: %s [--sweep [--rates=R1,R2,...] [--np=N] [--mpirun=CMD]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sweep) return runSweep(rates, numRates, mpirun, np);
+
+    if (openResult("word_frequencies.wcb", &serial) < 0) return 1;
+    if (openResult("word_frequencies_openmp.wcb", &openmp) < 0) return 1;
+    if (openResult("word_frequencies_mpi.wcb", &mpi) < 0) return 1;
+    if (openResult("final_word_count.wcb", &hybrid) < 0) return 1;
+
+    double rmseOpenMP = computeRMSE(&serial, &openmp);
+    double rmseMPI = computeRMSE(&serial, &mpi);
+    double rmseHybrid = computeRMSE(&serial, &hybrid);
 
     printf("RMSE OpenMP vs Serial: %f\n", rmseOpenMP);
     printf("RMSE MPI vs Serial: %f\n", rmseMPI);
     printf("RMSE Hybrid vs Serial: %f\n", rmseHybrid);
 
+    closeResult(&serial);
+    closeResult(&openmp);
+    closeResult(&mpi);
+    closeResult(&hybrid);
+
     return 0;
 }
@@ -2,13 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <time.h>
 
 #define MAX_WORD_LEN 100
 
 typedef struct {
     char word[MAX_WORD_LEN];
-    int count;
+    uint64_t count;
 } WordCount;
 // wordCount will store the word with its count
 
@@ -64,7 +65,80 @@ void addWord(char* word) {
     wordCount++;
 }
 
-int main() {
+// Binary result file: a ResultHeader, the count column, count + 1 key offsets
+// and the key blob, sorted by key so readers can mmap the file and
+// binary-search it without parsing. Key i is the NUL-terminated string at
+// offsets[i] in the blob.
+typedef struct {
+    char magic[4];          // "WCB1"
+    uint32_t version;
+    uint64_t count;         // number of words
+    uint64_t keyBytes;      // size of the key blob
+    uint64_t totalTokens;   // sum of all counts
+} ResultHeader;
+
+// Result writer; takes ownership of the word array and frees it
+typedef struct {
+    WordCount* words;
+    int count;
+    const char* filename;
+    int failed;
+} ResultWriter;
+
+int compareWords(const void* a, const void* b) {
+    return strcmp(((const WordCount*)a)->word, ((const WordCount*)b)->word);
+}
+
+void writeResultFile(ResultWriter* writer) {
+    int n = writer->count;
+    uint64_t* column = malloc(((size_t)n + 1) * sizeof(uint64_t));
+    FILE* file = fopen(writer->filename, "wb");
+    writer->failed = !column || !file;
+
+    if (!writer->failed) {
+        qsort(writer->words, n, sizeof(WordCount), compareWords);
+
+        ResultHeader header = { {'W', 'C', 'B', '1'}, 1, (uint64_t)n, 0, 0 };
+        for (int i = 0; i < n; i++) {
+            header.keyBytes += strlen(writer->words[i].word) + 1;
+            header.totalTokens += writer->words[i].count;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (int i = 0; i < n; i++) column[i] = writer->words[i].count;
+        fwrite(column, sizeof(uint64_t), n, file);
+
+        uint64_t offset = 0;
+        for (int i = 0; i < n; i++) {
+            column[i] = offset;
+            offset += strlen(writer->words[i].word) + 1;
+        }
+        column[n] = offset;
+        fwrite(column, sizeof(uint64_t), (size_t)n + 1, file);
+
+        for (int i = 0; i < n; i++) {
+            fwrite(writer->words[i].word, 1, strlen(writer->words[i].word) + 1, file);
+        }
+        writer->failed = ferror(file) != 0;
+    }
+    if (file && fclose(file) != 0) writer->failed = 1;
+    free(column);
+    free(writer->words);
+}
+
+int main(int argc, char** argv) {
+    // --text also prints the counts and saves them as text
+    int textOutput = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--text") == 0) {
+            textOutput = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--text]\n", argv[0]);
+            return 1;
+        }
+    }
+
+
     wordList = malloc(capacity * sizeof(WordCount));    
     //dynamically allocating memory using a pointer becuase the size of the text file 
     //word count is not known
@@ -93,28 +167,39 @@ int main() {
     fclose(file);
     clock_t end = clock();
 
-    printf("Word Frequencies:\n");
-    for (int i = 0; i < wordCount; i++) {
-        printf("%s: %d\n", wordList[i].word, wordList[i].count);
+    if (textOutput) {
+        printf("Word Frequencies:\n");
+        for (int i = 0; i < wordCount; i++) {
+            printf("%s: %llu\n", wordList[i].word, (unsigned long long)wordList[i].count);
+        }
     }
 
+    printf("Unique words: %d\n", wordCount);
     double time_spent = (double)(end - start) / CLOCKS_PER_SEC;
     printf("\nExecution time: %.6f seconds\n", time_spent);
 
     // Save the printed output to a file after printing
+    if (textOutput) {
 FILE* outputFile = fopen("word_frequencies.txt", "w");
 if (outputFile != NULL) {
     fprintf(outputFile, "Word Frequencies:\n");
     for (int i = 0; i < wordCount; i++) {
-        fprintf(outputFile, "%s: %d\n", wordList[i].word, wordList[i].count);
+        fprintf(outputFile, "%s: %llu\n", wordList[i].word, (unsigned long long)wordList[i].count);
     }
     fclose(outputFile);
     printf("Word frequencies saved to 'word_frequencies.txt'\n");
 } else {
     perror("Error opening file for writing");
 }
+    }
 
-
-    free(wordList);
+    // The writer sorts and frees wordList, so it runs after the text export
+    ResultWriter writer = { wordList, wordCount, "word_frequencies.wcb", 0 };
+    writeResultFile(&writer);
+    if (writer.failed) {
+        perror("Error writing word_frequencies.wcb");
+        return 1;
+    }
+    printf("Results saved to 'word_frequencies.wcb'\n");
     return 0;
 }
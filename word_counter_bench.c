@@ -0,0 +1,495 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <omp.h>
+
+// Micro-benchmarks for the kernels of word_counter_openmp.c. The file is
+// included below, so the benchmarks always time the code the counter runs.
+//
+//   gcc -O2 -fopenmp -o word_counter_bench word_counter_bench.c -lm -pthread
+//   ./word_counter_bench [--reps=N] [--ops=N] [--filter=TEXT] [--csv=FILE]
+//                        [--compare=BASELINE.csv] [--threshold=PERCENT]
+
+// Memory traffic of the kernels: their malloc/realloc calls and the arena's
+// mmap/mremap calls are counted here
+uint64_t benchBytes = 0;
+uint64_t benchAllocs = 0;
+
+void* benchMalloc(size_t size) {
+    benchBytes += size;
+    benchAllocs++;
+    return malloc(size);
+}
+
+void* benchRealloc(void* ptr, size_t size) {
+    benchBytes += size;
+    benchAllocs++;
+    return realloc(ptr, size);
+}
+
+void* benchMmap(void* addr, size_t size, int prot, int flags, int fd, off_t offset) {
+    benchBytes += size;
+    benchAllocs++;
+    return mmap(addr, size, prot, flags, fd, offset);
+}
+
+void* benchMremap(void* ptr, size_t oldSize, size_t size, int flags) {
+    benchBytes += size;
+    benchAllocs++;
+    return mremap(ptr, oldSize, size, flags);
+}
+
+#define malloc(size) benchMalloc(size)
+#define realloc(ptr, size) benchRealloc(ptr, size)
+#define mmap(addr, size, prot, flags, fd, offset) benchMmap(addr, size, prot, flags, fd, offset)
+#define mremap(ptr, oldSize, size, flags) benchMremap(ptr, oldSize, size, flags)
+#define WORD_COUNTER_NO_MAIN
+#include "word_counter_openmp.c"
+#undef malloc
+#undef realloc
+#undef mmap
+#undef mremap
+
+#define MAX_REPS 100
+#define MAX_RESULTS 64
+#define BASE_CAPACITY 1000  // words reserved for lists left to grow, with 8 key bytes each
+
+Arena benchArena;
+
+typedef struct {
+    char name[80];
+    double samples[MAX_REPS];   // ns/op of each repetition
+    int reps;
+    double median, mean, stddev, min;
+    double bytesPerOp;
+    double allocsPerOp;
+} Result;
+
+// Words stored back to back, like the WordList key pool
+typedef struct {
+    char* pool;
+    size_t* offsets;
+    int count;
+} WordSet;
+
+Result results[MAX_RESULTS];
+int numResults = 0;
+int numReps = 10;
+long numOps = 1 << 18;
+const char* filter = NULL;
+
+Result* current = NULL;
+double timerStart;
+uint64_t bytesAtStart, allocsAtStart;
+double bytesTotal, allocsTotal;
+volatile uint64_t sink;     // keeps the timed loops from being optimized away
+
+uint64_t rngState = 0x9e3779b97f4a7c15ULL;
+
+uint64_t nextRandom(void) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+int randomBetween(int lo, int hi) {
+    return lo + (int)(nextRandom() % (uint64_t)(hi - lo + 1));
+}
+
+double nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void initWordSet(WordSet* set, int count, int maxLen) {
+    set->pool = calloc((size_t)count, maxLen + 1);
+    set->offsets = calloc(count, sizeof(size_t));
+    set->count = count;
+    if (!set->pool || !set->offsets) {
+        fprintf(stderr, "Memory allocation failed for word set\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeWordSet(WordSet* set) {
+    free(set->pool);
+    free(set->offsets);
+}
+
+const char* wordAt(const WordSet* set, int i) {
+    return set->pool + set->offsets[i];
+}
+
+// count distinct lowercase words of minLen..maxLen letters: a fixed-width
+// base-26 index keeps them distinct, random letters pad them to length
+void makeVocabulary(WordSet* set, int count, int minLen, int maxLen) {
+    int width = 1;
+    for (long span = 26; span < count; span *= 26) width++;
+    if (minLen < width) minLen = width;
+    if (maxLen < minLen) maxLen = minLen;
+    initWordSet(set, count, maxLen);
+    size_t used = 0;
+    for (int i = 0; i < count; i++) {
+        char* w = set->pool + used;
+        int len = randomBetween(minLen, maxLen);
+        int index = i;
+        for (int k = 0; k < width; k++) {
+            w[k] = 'a' + index % 26;
+            index /= 26;
+        }
+        for (int k = width; k < len; k++) w[k] = 'a' + nextRandom() % 26;
+        w[len] = '\0';
+        set->offsets[i] = used;
+        used += len + 1;
+    }
+}
+
+// count raw tokens of minLen..maxLen characters; noisePct percent of the
+// characters are capitals, digits or punctuation that cleanWord must handle
+void makeTokens(WordSet* set, int count, int minLen, int maxLen, int noisePct) {
+    static const char noise[] = "ABCXYZ0123456789.,;:!?'\"()-";
+    initWordSet(set, count, maxLen);
+    size_t used = 0;
+    for (int i = 0; i < count; i++) {
+        char* w = set->pool + used;
+        int len = randomBetween(minLen, maxLen);
+        for (int k = 0; k < len; k++) {
+            w[k] = (int)(nextRandom() % 100) < noisePct ? noise[nextRandom() % (sizeof(noise) - 1)]
+                                                        : (char)('a' + nextRandom() % 26);
+        }
+        w[len] = '\0';
+        set->offsets[i] = used;
+        used += len + 1;
+    }
+}
+
+void fillWordList(WordList* list, const WordSet* set, int count) {
+    for (int i = 0; i < count; i++) addWordToList(list, wordAt(set, i));
+}
+
+// Start a benchmark; returns 0 if --filter skips it
+int beginBench(const char* name) {
+    if (filter && !strstr(name, filter)) return 0;
+    if (numResults == MAX_RESULTS) {
+        fprintf(stderr, "Too many benchmarks\n");
+        exit(EXIT_FAILURE);
+    }
+    current = &results[numResults++];
+    memset(current, 0, sizeof(*current));
+    snprintf(current->name, sizeof(current->name), "%s", name);
+    bytesTotal = allocsTotal = 0.0;
+    return 1;
+}
+
+void startTimer(void) {
+    bytesAtStart = benchBytes;
+    allocsAtStart = benchAllocs;
+    timerStart = nowNanos();
+}
+
+// Record one repetition of ops operations; rep 0 is a discarded warm-up
+void stopTimer(int rep, long ops) {
+    double elapsed = nowNanos() - timerStart;
+    if (rep == 0) return;
+    current->samples[current->reps++] = elapsed / ops;
+    bytesTotal += (double)(benchBytes - bytesAtStart) / ops;
+    allocsTotal += (double)(benchAllocs - allocsAtStart) / ops;
+}
+
+int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void endBench(void) {
+    Result* r = current;
+    double sorted[MAX_REPS];
+    memcpy(sorted, r->samples, r->reps * sizeof(double));
+    qsort(sorted, r->reps, sizeof(double), compareDouble);
+    r->median = r->reps % 2 ? sorted[r->reps / 2] : (sorted[r->reps / 2 - 1] + sorted[r->reps / 2]) / 2.0;
+    r->min = sorted[0];
+    double sum = 0.0, sq = 0.0;
+    for (int i = 0; i < r->reps; i++) sum += r->samples[i];
+    r->mean = sum / r->reps;
+    for (int i = 0; i < r->reps; i++) sq += (r->samples[i] - r->mean) * (r->samples[i] - r->mean);
+    r->stddev = r->reps > 1 ? sqrt(sq / (r->reps - 1)) : 0.0;
+    r->bytesPerOp = bytesTotal / r->reps;
+    r->allocsPerOp = allocsTotal / r->reps;
+    printf("%-52s %10.2f %10.2f %9.2f %10.2f %10.2f %9.4f\n", r->name, r->median, r->mean, r->stddev, r->min,
+           r->bytesPerOp, r->allocsPerOp);
+    fflush(stdout);
+}
+
+// cleanWord on raw tokens; each op copies the token first since cleaning is in place
+void benchCleanWord(const char* label, int minLen, int maxLen, int noisePct) {
+    char name[80];
+    snprintf(name, sizeof(name), "cleanWord/len=%s", label);
+    if (!beginBench(name)) return;
+    WordSet tokens;
+    makeTokens(&tokens, (int)numOps, minLen, maxLen, noisePct);
+    char buffer[MAX_WORD_LEN];
+    for (int rep = 0; rep <= numReps; rep++) {
+        startTimer();
+        for (long i = 0; i < numOps; i++) {
+            const char* token = wordAt(&tokens, (int)i);
+            memcpy(buffer, token, strlen(token) + 1);
+            cleanWord(buffer);
+            sink += (unsigned char)buffer[0];
+        }
+        stopTimer(rep, numOps);
+    }
+    freeWordSet(&tokens);
+    endBench();
+}
+
+// Insert a token stream into a list already holding vocab words; hitPct
+// percent of the tokens are resident words, the rest are new words
+void benchInsert(int vocab, int hitPct, int precomputedHash) {
+    char name[80];
+    snprintf(name, sizeof(name), "%s/vocab=%d/hit=%d", precomputedHash ? "addWordWithHash" : "addWordToList",
+             vocab, hitPct);
+    if (!beginBench(name)) return;
+    WordSet words;
+    makeVocabulary(&words, vocab + (int)numOps, 3, 10);
+    int* stream = malloc(numOps * sizeof(int));
+    uint64_t* hashes = malloc(numOps * sizeof(uint64_t));
+    int fresh = vocab;
+    for (long i = 0; i < numOps; i++) {
+        stream[i] = (int)(nextRandom() % 100) < hitPct ? (int)(nextRandom() % vocab) : fresh++;
+        hashes[i] = hashWord(wordAt(&words, stream[i]));
+    }
+    for (int rep = 0; rep <= numReps; rep++) {
+        WordList list;
+        initWordList(&list, &benchArena, BASE_CAPACITY, BASE_CAPACITY * 8);
+        fillWordList(&list, &words, vocab);
+        startTimer();
+        if (precomputedHash) {
+            for (long i = 0; i < numOps; i++) addWordWithHash(&list, wordAt(&words, stream[i]), hashes[i], 1);
+        } else {
+            for (long i = 0; i < numOps; i++) addWordToList(&list, wordAt(&words, stream[i]));
+        }
+        stopTimer(rep, numOps);
+        sink += list.count;
+        freeWordList(&list);
+    }
+    free(stream);
+    free(hashes);
+    freeWordSet(&words);
+    endBench();
+}
+
+// Count a stream of resident words through a ProbeBatch of batchSize words;
+// batch 1 is the unbatched addWordToList loop. Only counts change, so the list
+// is built once and every repetition probes the same table.
+void benchProbeBatch(int vocab, int batchSize) {
+    char name[80];
+    snprintf(name, sizeof(name), "probeBatch/vocab=%d/batch=%d", vocab, batchSize);
+    if (!beginBench(name)) return;
+    WordSet words;
+    makeVocabulary(&words, vocab, 3, 10);
+    WordList list;
+    initWordList(&list, &benchArena, BASE_CAPACITY, BASE_CAPACITY * 8);
+    fillWordList(&list, &words, vocab);
+    const char** stream = malloc(numOps * sizeof(char*));
+    for (long i = 0; i < numOps; i++) stream[i] = wordAt(&words, (int)(nextRandom() % vocab));
+    ProbeBatch batch;
+    initProbeBatch(&batch, batchSize);
+    for (int rep = 0; rep <= numReps; rep++) {
+        startTimer();
+        if (batchSize > 1) {
+            for (long i = 0; i < numOps; i++) queueProbe(&batch, &list, stream[i], hashWord(stream[i]));
+            drainProbeBatch(&batch, &list);
+        } else {
+            for (long i = 0; i < numOps; i++) addWordToList(&list, stream[i]);
+        }
+        stopTimer(rep, numOps);
+    }
+    sink += list.counts[0];
+    freeWordList(&list);
+    free(stream);
+    freeWordSet(&words);
+    endBench();
+}
+
+// Merge a srcSize-word list into a destSize-word list; overlapPct percent of
+// the source words already exist in the destination. One op is one source word.
+void benchMerge(int destSize, int srcSize, int overlapPct) {
+    char name[80];
+    snprintf(name, sizeof(name), "mergeWordLists/dest=%d/src=%d/overlap=%d", destSize, srcSize, overlapPct);
+    if (!beginBench(name)) return;
+    WordSet words;
+    makeVocabulary(&words, destSize + srcSize, 3, 10);
+    WordList src;
+    initWordList(&src, &benchArena, BASE_CAPACITY, BASE_CAPACITY * 8);
+    int shared = (int)((long)srcSize * overlapPct / 100);
+    if (shared > destSize) shared = destSize;
+    for (int i = 0; i < shared; i++) addWordWithCount(&src, wordAt(&words, i), 1 + nextRandom() % 50);
+    for (int i = shared; i < srcSize; i++) addWordWithCount(&src, wordAt(&words, destSize + i), 1 + nextRandom() % 50);
+    for (int rep = 0; rep <= numReps; rep++) {
+        WordList dest;
+        initWordList(&dest, &benchArena, BASE_CAPACITY, BASE_CAPACITY * 8);
+        fillWordList(&dest, &words, destSize);
+        startTimer();
+        mergeWordLists(&dest, &src);
+        stopTimer(rep, src.count);
+        sink += dest.count;
+        freeWordList(&dest);
+    }
+    freeWordList(&src);
+    freeWordSet(&words);
+    endBench();
+}
+
+// Insert count distinct words into a list reserved for startCapacity words, so
+// the ensureCapacity growth path (mremap of the columns and key pool, index
+// rebuilds) is timed
+void benchGrowth(int count, int startCapacity) {
+    char name[80];
+    snprintf(name, sizeof(name), "ensureCapacity/words=%d/start=%d", count, startCapacity);
+    if (!beginBench(name)) return;
+    WordSet words;
+    makeVocabulary(&words, count, 3, 10);
+    for (int rep = 0; rep <= numReps; rep++) {
+        WordList list;
+        startTimer();
+        initWordList(&list, &benchArena, startCapacity, (size_t)startCapacity * 8);
+        fillWordList(&list, &words, count);
+        stopTimer(rep, count);
+        sink += list.count;
+        freeWordList(&list);
+    }
+    freeWordSet(&words);
+    endBench();
+}
+
+int writeCsv(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        return -1;
+    }
+    fprintf(file, "benchmark,reps,median_ns,mean_ns,stddev_ns,min_ns,bytes_per_op,allocs_per_op\n");
+    for (int i = 0; i < numResults; i++) {
+        Result* r = &results[i];
+        fprintf(file, "%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.5f\n", r->name, r->reps, r->median, r->mean, r->stddev,
+                r->min, r->bytesPerOp, r->allocsPerOp);
+    }
+    fclose(file);
+    printf("Results saved to '%s'\n", filename);
+    return 0;
+}
+
+// Compare against a CSV from an earlier run; a benchmark counts as a
+// regression when both its median and its fastest repetition are slower than
+// the baseline's by more than threshold percent, which filters out runs where
+// only a few repetitions were disturbed. Returns the number of regressions.
+int compareBaseline(const char* filename, double threshold) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return -1;
+    }
+    printf("\n%-52s %12s %12s %9s\n", "Benchmark", "Base ns/op", "Now ns/op", "Change");
+    char line[512];
+    int regressions = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[80];
+        int reps;
+        double median, min, bytes;
+        if (sscanf(line, "%79[^,],%d,%lf,%*f,%*f,%lf,%lf", name, &reps, &median, &min, &bytes) != 5) continue;
+        for (int i = 0; i < numResults; i++) {
+            Result* r = &results[i];
+            if (strcmp(r->name, name) != 0) continue;
+            double change = median > 0.0 ? 100.0 * (r->median - median) / median : 0.0;
+            int slower = change > threshold && min > 0.0 && 100.0 * (r->min - min) / min > threshold;
+            regressions += slower;
+            printf("%-52s %12.2f %12.2f %+8.1f%%%s%s\n", name, median, r->median, change,
+                   slower ? "  REGRESSION" : "", r->bytesPerOp > bytes + 0.5 ? "  MORE BYTES/OP" : "");
+        }
+    }
+    fclose(file);
+    printf("%d regression(s) over %.1f%%\n", regressions, threshold);
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    const char* csvFile = NULL;
+    const char* baselineFile = NULL;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--reps=", 7) == 0) {
+            numReps = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--ops=", 6) == 0) {
+            numOps = atol(argv[i] + 6);
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--csv=", 6) == 0) {
+            csvFile = argv[i] + 6;
+        } else if (strncmp(argv[i], "--compare=", 10) == 0) {
+            baselineFile = argv[i] + 10;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            threshold = atof(argv[i] + 12);
+        } else {
+            fprintf(stderr, "Usage: %s [--reps=N] [--ops=N] [--filter=TEXT] [--csv=FILE] "
+                            "[--compare=BASELINE.csv] [--threshold=PERCENT]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numReps < 1 || numReps > MAX_REPS || numOps < 1 || numOps > 1 << 24) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    initArena(&benchArena);
+    printf("%d repetitions after one warm-up, %ld ops per repetition\n", numReps, numOps);
+    printf("%-52s %10s %10s %9s %10s %10s %9s\n", "Benchmark", "Median ns", "Mean ns", "Stddev", "Min ns",
+           "Bytes/op", "Allocs/op");
+
+    benchCleanWord("short", 2, 5, 10);
+    benchCleanWord("medium", 5, 10, 10);
+    benchCleanWord("long", 20, 40, 10);
+    benchCleanWord("noisy", 5, 10, 40);
+
+    int vocabs[] = { 1000, 16384, 262144 };
+    int hits[] = { 100, 90, 50 };
+    for (int v = 0; v < 3; v++) {
+        for (int h = 0; h < 3; h++) benchInsert(vocabs[v], hits[h], 0);
+    }
+    benchInsert(16384, 100, 1);
+    benchInsert(16384, 50, 1);
+
+    int probeVocabs[] = { 16384, 262144, 1 << 20 };
+    int probeBatches[] = { 1, 16, 32, 64 };
+    for (int v = 0; v < 3; v++) {
+        for (int b = 0; b < 4; b++) benchProbeBatch(probeVocabs[v], probeBatches[b]);
+    }
+
+    benchMerge(16384, 16384, 0);
+    benchMerge(16384, 16384, 50);
+    benchMerge(16384, 16384, 100);
+    benchMerge(262144, 16384, 90);
+    benchMerge(1000, 262144, 0);
+
+    benchGrowth(262144, 16);
+    benchGrowth(262144, BASE_CAPACITY);
+    benchGrowth(262144, 262144);
+
+    printArenaStats(&benchArena, 1);
+
+    int status = 0;
+    if (csvFile && writeCsv(csvFile) < 0) status = 1;
+    if (baselineFile) {
+        int regressions = compareBaseline(baselineFile, threshold);
+        if (regressions != 0) status = 1;
+    }
+    return status;
+}
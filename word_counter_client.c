@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_WORD_LEN 100
+#define MAX_THREADS 64
+#define DEFAULT_SOCKET_PATH "/tmp/word_counter.sock"
+
+// Must match the protocol in word_counter_daemon.c
+enum {
+    OP_LOOKUP = 1,
+    OP_BATCH = 2,
+    OP_TOPN = 3,
+    OP_APPEND = 4,
+    OP_STATS = 5
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t pad[3];
+    uint32_t len;
+} FrameHeader;
+
+typedef enum { MODE_LOOKUP, MODE_BATCH, MODE_TOPN } Mode;
+
+typedef struct {
+    int id;
+    double* latencies;  // per-request latency in microseconds
+    int failed;
+} Worker;
+
+const char* socketPath = DEFAULT_SOCKET_PATH;
+Mode mode = MODE_LOOKUP;
+int numRequests = 100000;   // per client thread
+int batchSize = 64;
+int topN = 10;
+
+// Vocabulary sampled from the daemon's top words, used as query keys
+char (*vocab)[MAX_WORD_LEN] = NULL;
+int vocabSize = 0;
+
+double nowMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int connectDaemon(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int writeAll(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int readAll(int fd, void* data, size_t len) {
+    char* p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send one request and read the whole response into *out; returns the
+// response status or -1 on a transport error. The caller frees *out only on
+// status 0; error responses are freed here.
+int roundTrip(int fd, uint8_t op, const void* payload, uint32_t len, char** out, uint32_t* outLen) {
+    FrameHeader header = { op, {0, 0, 0}, len };
+    if (writeAll(fd, &header, sizeof(header)) < 0) return -1;
+    if (len && writeAll(fd, payload, len) < 0) return -1;
+    if (readAll(fd, &header, sizeof(header)) < 0) return -1;
+    *out = malloc(header.len ? header.len : 1);
+    if (!*out) return -1;
+    if (header.len && readAll(fd, *out, header.len) < 0) {
+        free(*out);
+        return -1;
+    }
+    *outLen = header.len;
+    if (header.op != 0) {
+        free(*out);
+        *out = NULL;
+    }
+    return header.op;
+}
+
+// Fetch up to n top words to use as the query vocabulary
+int loadVocabulary(int n) {
+    int fd = connectDaemon();
+    if (fd < 0) {
+        perror(socketPath);
+        return -1;
+    }
+    uint32_t want = n;
+    char* resp;
+    uint32_t respLen;
+    if (roundTrip(fd, OP_TOPN, &want, sizeof(want), &resp, &respLen) != 0) {
+        fprintf(stderr, "Top-N request failed\n");
+        close(fd);
+        return -1;
+    }
+    // Parse n x {uint64 count, uint16 len, bytes}, never past respLen
+    uint32_t got = 0;
+    if (respLen >= sizeof(got)) memcpy(&got, resp, sizeof(got));
+    if (respLen < sizeof(got) || got > (respLen - sizeof(got)) / (sizeof(uint64_t) + sizeof(uint16_t))) {
+        fprintf(stderr, "Malformed top-N response\n");
+        free(resp);
+        close(fd);
+        return -1;
+    }
+    vocab = malloc((got ? got : 1) * sizeof(*vocab));
+    if (!vocab) {
+        fprintf(stderr, "Memory allocation failed for vocabulary\n");
+        free(resp);
+        close(fd);
+        return -1;
+    }
+    size_t pos = sizeof(got);
+    uint32_t parsed = 0;
+    for (; parsed < got; parsed++) {
+        uint16_t wlen;
+        if (respLen < pos + sizeof(uint64_t) + sizeof(wlen)) break;
+        pos += sizeof(uint64_t);
+        memcpy(&wlen, resp + pos, sizeof(wlen));
+        pos += sizeof(wlen);
+        if (wlen >= MAX_WORD_LEN || respLen - pos < wlen) break;
+        memcpy(vocab[parsed], resp + pos, wlen);
+        vocab[parsed][wlen] = '\0';
+        pos += wlen;
+    }
+    free(resp);
+    if (parsed < got) {
+        fprintf(stderr, "Malformed top-N response\n");
+        close(fd);
+        return -1;
+    }
+    vocabSize = got;
+    close(fd);
+    return vocabSize > 0 ? 0 : -1;
+}
+
+void* runWorker(void* arg) {
+    Worker* w = arg;
+    int fd = connectDaemon();
+    if (fd < 0) {
+        w->failed = 1;
+        return NULL;
+    }
+    unsigned int seed = 12345u + w->id;
+    char* payload = malloc((size_t)batchSize * MAX_WORD_LEN);
+
+    for (int r = 0; r < numRequests; r++) {
+        uint8_t op;
+        uint32_t len = 0;
+        if (mode == MODE_LOOKUP) {
+            const char* word = vocab[rand_r(&seed) % vocabSize];
+            len = strlen(word);
+            memcpy(payload, word, len);
+            op = OP_LOOKUP;
+        } else if (mode == MODE_BATCH) {
+            for (int b = 0; b < batchSize; b++) {
+                const char* word = vocab[rand_r(&seed) % vocabSize];
+                size_t wlen = strlen(word) + 1;
+                memcpy(payload + len, word, wlen);
+                len += wlen;
+            }
+            op = OP_BATCH;
+        } else {
+            uint32_t n = topN;
+            memcpy(payload, &n, sizeof(n));
+            len = sizeof(n);
+            op = OP_TOPN;
+        }
+
+        char* resp;
+        uint32_t respLen;
+        double t0 = nowMicros();
+        if (roundTrip(fd, op, payload, len, &resp, &respLen) != 0) {
+            w->failed = 1;
+            break;
+        }
+        w->latencies[r] = nowMicros() - t0;
+        free(resp);
+    }
+    free(payload);
+    close(fd);
+    return NULL;
+}
+
+int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    int numThreads = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+            numRequests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            mode = MODE_BATCH;
+            batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--topn") == 0 && i + 1 < argc) {
+            mode = MODE_TOPN;
+            topN = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--socket PATH] [--requests N] [--clients C] [--batch K | --topn N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numRequests <= 0 || numThreads <= 0 || numThreads > MAX_THREADS || batchSize <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    if (loadVocabulary(10000) < 0) return 1;
+
+    Worker workers[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    for (int t = 0; t < numThreads; t++) {
+        workers[t].id = t;
+        workers[t].failed = 0;
+        workers[t].latencies = calloc(numRequests, sizeof(double));
+        if (!workers[t].latencies) {
+            fprintf(stderr, "Memory allocation failed for latencies\n");
+            return 1;
+        }
+    }
+
+    double start = nowMicros();
+    for (int t = 0; t < numThreads; t++) {
+        pthread_create(&threads[t], NULL, runWorker, &workers[t]);
+    }
+    for (int t = 0; t < numThreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = (nowMicros() - start) / 1e6;
+
+    long total = (long)numRequests * numThreads;
+    double* all = malloc(total * sizeof(double));
+    for (int t = 0; t < numThreads; t++) {
+        if (workers[t].failed) {
+            fprintf(stderr, "Client %d failed\n", t);
+            return 1;
+        }
+        memcpy(all + (long)t * numRequests, workers[t].latencies, numRequests * sizeof(double));
+        free(workers[t].latencies);
+    }
+    qsort(all, total, sizeof(double), compareDouble);
+
+    double sum = 0.0;
+    for (long i = 0; i < total; i++) sum += all[i];
+
+    const char* modeName = mode == MODE_LOOKUP ? "lookup" : mode == MODE_BATCH ? "batch" : "topn";
+    printf("Mode: %s, clients: %d, requests: %ld, vocabulary: %d\n", modeName, numThreads, total, vocabSize);
+    printf("Throughput: %.0f requests/s", total / elapsed);
+    if (mode == MODE_BATCH) printf(" (%.0f words/s)", total * (double)batchSize / elapsed);
+    printf("\n");
+    printf("Latency (us): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+           sum / total, all[total / 2], all[(long)(total * 0.90)], all[(long)(total * 0.99)], all[total - 1]);
+
+    free(all);
+    free(vocab);
+    return 0;
+}
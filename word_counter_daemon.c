@@ -0,0 +1,733 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_WORD_LEN 100
+#define MAX_CLIENTS 64
+#define DEFAULT_SOCKET_PATH "/tmp/word_counter.sock"
+
+// Wire protocol: every request and response is a fixed 8-byte header followed
+// by `len` payload bytes. Integers are in host byte order (the socket is local).
+//
+//   OP_LOOKUP  payload: word bytes            -> uint64 count
+//   OP_BATCH   payload: NUL-terminated words  -> uint32 n, uint64 count[n]
+//   OP_TOPN    payload: uint32 n              -> uint32 n, n x {uint64 count, uint16 len, bytes}
+//   OP_APPEND  payload: raw text              -> uint64 tokens counted
+//   OP_STATS   payload: none                  -> uint64 unique words, uint64 total tokens
+//
+// Appends form one text stream per connection: a token cut by the end of a
+// frame is held until the next OP_APPEND (or the disconnect) finishes it, and
+// is counted then.
+enum {
+    OP_LOOKUP = 1,
+    OP_BATCH = 2,
+    OP_TOPN = 3,
+    OP_APPEND = 4,
+    OP_STATS = 5
+};
+
+enum {
+    STATUS_OK = 0,
+    STATUS_BAD_REQUEST = 1
+};
+
+typedef struct {
+    uint8_t op;         // request opcode, or status in a response
+    uint8_t pad[3];
+    uint32_t len;       // payload length in bytes
+} FrameHeader;
+
+#define MAX_FRAME_LEN (64u * 1024u * 1024u)
+#define MAX_PENDING_OUTPUT (4u * 1024u * 1024u)  // stop reading a client with this much unsent output
+
+// Resident dictionary: the structure-of-arrays WordList used by the counters,
+// whose open-addressing index keeps point lookups off the whole list
+typedef struct {
+    uint64_t* hashes;       // hash of each word
+    size_t* keyOffsets;     // offset of each word in keyPool
+    uint64_t* counts;       // occurrences of each word
+    int count;              // number of unique words
+    int capacity;           // current capacity of the columns
+    char* keyPool;          // NUL-terminated words stored back to back
+    size_t keyPoolUsed;
+    size_t keyPoolCapacity;
+    int* slots;             // open-addressing index into the columns, -1 if empty
+    int slotCapacity;       // always a power of two
+} WordList;
+
+typedef struct {
+    int fd;
+    char* buf;          // bytes received but not yet handled
+    size_t len;
+    size_t cap;
+    char* out;          // responses not yet written; out[outPos, outLen) is pending
+    size_t outPos;
+    size_t outLen;
+    size_t outCap;
+    char tail[MAX_WORD_LEN];    // unfinished token at the end of the last OP_APPEND
+    size_t tailLen;
+} Client;
+
+WordList dictionary;
+uint64_t totalTokens = 0;
+
+// Cached descending-count order for OP_TOPN, rebuilt after appends
+int* topOrder = NULL;
+int topOrderValid = 0;
+
+volatile sig_atomic_t running = 1;
+
+void handleSignal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Clean word by removing punctuation and converting to lowercase
+void cleanWord(char* word) {
+    int i, j = 0;
+    char temp[MAX_WORD_LEN];
+    for (i = 0; word[i] != '\0'; i++) {
+        if (isalpha((unsigned char)word[i])) {
+            temp[j++] = tolower((unsigned char)word[i]);
+        }
+    }
+    temp[j] = '\0';
+    strcpy(word, temp);
+}
+
+// FNV-1a hash of a cleaned word
+uint64_t hashWord(const char* word) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *word; word++) {
+        h ^= (unsigned char)*word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void initWordList(WordList* list, int capacity) {
+    list->hashes = malloc(capacity * sizeof(uint64_t));
+    list->keyOffsets = malloc(capacity * sizeof(size_t));
+    list->counts = malloc(capacity * sizeof(uint64_t));
+    list->keyPoolCapacity = (size_t)capacity * 8;
+    list->keyPool = malloc(list->keyPoolCapacity);
+    list->slotCapacity = 1;
+    while (list->slotCapacity < capacity * 2) list->slotCapacity <<= 1;
+    list->slots = malloc(list->slotCapacity * sizeof(int));
+    if (!list->hashes || !list->keyOffsets || !list->counts || !list->keyPool || !list->slots) {
+        fprintf(stderr, "Memory allocation failed for WordList\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(list->slots, -1, list->slotCapacity * sizeof(int));
+    list->count = 0;
+    list->capacity = capacity;
+    list->keyPoolUsed = 0;
+}
+
+// Free WordList memory
+void freeWordList(WordList* list) {
+    free(list->hashes);
+    free(list->keyOffsets);
+    free(list->counts);
+    free(list->keyPool);
+    free(list->slots);
+    memset(list, 0, sizeof(*list));
+}
+
+// Word stored at index i of a WordList
+const char* getWord(const WordList* list, int i) {
+    return list->keyPool + list->keyOffsets[i];
+}
+
+// Rebuild the index at twice the size from the stored hashes
+void growSlots(WordList* list) {
+    int newSlotCapacity = list->slotCapacity * 2;
+    int* newSlots = malloc(newSlotCapacity * sizeof(int));
+    if (!newSlots) {
+        fprintf(stderr, "Memory reallocation failed\n");
+        freeWordList(list);
+        exit(EXIT_FAILURE);
+    }
+    memset(newSlots, -1, newSlotCapacity * sizeof(int));
+    for (int i = 0; i < list->count; i++) {
+        int s = (int)(list->hashes[i] & (newSlotCapacity - 1));
+        while (newSlots[s] != -1) s = (s + 1) & (newSlotCapacity - 1);
+        newSlots[s] = i;
+    }
+    free(list->slots);
+    list->slots = newSlots;
+    list->slotCapacity = newSlotCapacity;
+}
+
+// Make room for one more word of length wordLen in WordList
+void ensureCapacity(WordList* list, size_t wordLen) {
+    if (list->count >= list->capacity) {
+        int newCapacity = list->capacity * 2;
+        uint64_t* newHashes = realloc(list->hashes, newCapacity * sizeof(uint64_t));
+        if (newHashes) list->hashes = newHashes;
+        size_t* newOffsets = realloc(list->keyOffsets, newCapacity * sizeof(size_t));
+        if (newOffsets) list->keyOffsets = newOffsets;
+        uint64_t* newCounts = realloc(list->counts, newCapacity * sizeof(uint64_t));
+        if (newCounts) list->counts = newCounts;
+        if (!newHashes || !newOffsets || !newCounts) {
+            fprintf(stderr, "Memory reallocation failed\n");
+            freeWordList(list);
+            exit(EXIT_FAILURE);
+        }
+        list->capacity = newCapacity;
+    }
+    if (list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity) {
+        size_t newPoolCapacity = list->keyPoolCapacity * 2 + wordLen + 1;
+        char* newPool = realloc(list->keyPool, newPoolCapacity);
+        if (!newPool) {
+            fprintf(stderr, "Memory reallocation failed\n");
+            freeWordList(list);
+            exit(EXIT_FAILURE);
+        }
+        list->keyPool = newPool;
+        list->keyPoolCapacity = newPoolCapacity;
+    }
+    if (list->count * 2 >= list->slotCapacity) {
+        growSlots(list);
+    }
+}
+
+// Return the index of word in list, or -1 if absent
+int findWord(const WordList* list, const char* word) {
+    uint64_t hash = hashWord(word);
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) return i;
+        s = (s + 1) & mask;
+    }
+    return -1;
+}
+
+// Add word with a precomputed hash and a given count in a given WordList
+void addWordWithHash(WordList* list, const char* word, uint64_t hash, uint64_t count) {
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) {
+            list->counts[i] += count;  // if the word already exists in the list
+            return;
+        }
+        s = (s + 1) & mask;
+    }
+    // Add new word if not exists with the given count
+    size_t wordLen = strlen(word);
+    if (list->count >= list->capacity || list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity ||
+        list->count * 2 >= list->slotCapacity) {
+        ensureCapacity(list, wordLen);
+        mask = list->slotCapacity - 1;
+        s = (int)(hash & mask);
+        while (list->slots[s] != -1) s = (s + 1) & mask;
+    }
+    list->slots[s] = list->count;
+    list->hashes[list->count] = hash;
+    list->keyOffsets[list->count] = list->keyPoolUsed;
+    list->counts[list->count] = count;
+    memcpy(list->keyPool + list->keyPoolUsed, word, wordLen + 1);
+    list->keyPoolUsed += wordLen + 1;
+    list->count++;
+}
+
+// Add word with a given count in a given WordList
+void addWordWithCount(WordList* list, const char* word, uint64_t count) {
+    addWordWithHash(list, word, hashWord(word), count);
+}
+
+// Add word in a given WordList
+void addWordToList(WordList* list, const char* word) {
+    addWordWithCount(list, word, 1);
+}
+
+// Split text on whitespace the way fscanf("%99s") does and count every
+// cleaned token; returns the number of tokens added
+uint64_t countText(WordList* list, const char* text, size_t len) {
+    uint64_t added = 0;
+    size_t i = 0;
+    char word[MAX_WORD_LEN];
+    while (i < len) {
+        while (i < len && isspace((unsigned char)text[i])) i++;
+        int j = 0;
+        while (i < len && !isspace((unsigned char)text[i]) && j < MAX_WORD_LEN - 1) {
+            word[j++] = text[i++];
+        }
+        if (j == 0) break;
+        word[j] = '\0';
+        cleanWord(word);
+        if (strlen(word) > 0) {
+            addWordWithCount(list, word, 1);
+            added++;
+        }
+    }
+    totalTokens += added;
+    topOrderValid = 0;
+    return added;
+}
+
+// Build the dictionary by counting a text file such as input.txt
+int buildFromText(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return -1;
+    }
+    char word[MAX_WORD_LEN];
+    while (fscanf(file, "%99s", word) == 1) {
+        cleanWord(word);
+        if (strlen(word) > 0) {
+            addWordWithCount(&dictionary, word, 1);
+            totalTokens++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// Header of the binary result files written by the counters
+typedef struct {
+    char magic[4];          // "WCB1"
+    uint32_t version;
+    uint64_t count;
+    uint64_t keyBytes;
+    uint64_t totalTokens;
+} ResultHeader;
+
+// Load a binary result file by mapping it and reading the columns in place;
+// returns 1 if the file is not in the binary format
+int loadBinaryResult(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror(filename);
+        return -1;
+    }
+    struct stat st;
+    ResultHeader header;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header) ||
+        read(fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, "WCB1", 4) != 0) {
+        close(fd);
+        return 1;
+    }
+    uint64_t n = header.count;
+    if (header.version != 1 || n > (uint64_t)st.st_size / (2 * sizeof(uint64_t)) ||
+        sizeof(header) + (n * 2 + 1) * sizeof(uint64_t) + header.keyBytes != (size_t)st.st_size) {
+        fprintf(stderr, "%s: corrupt result file\n", filename);
+        close(fd);
+        return -1;
+    }
+    char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(filename);
+        return -1;
+    }
+    const uint64_t* counts = (const uint64_t*)(map + sizeof(header));
+    const uint64_t* offsets = counts + n;
+    const char* keys = (const char*)(offsets + n + 1);
+    for (uint64_t i = 0; i < n; i++) {
+        if (offsets[i] >= header.keyBytes || memchr(keys + offsets[i], '\0', header.keyBytes - offsets[i]) == NULL) {
+            fprintf(stderr, "%s: corrupt key blob\n", filename);
+            munmap(map, st.st_size);
+            return -1;
+        }
+        addWordWithCount(&dictionary, keys + offsets[i], counts[i]);
+    }
+    totalTokens += header.totalTokens;
+    munmap(map, st.st_size);
+    return 0;
+}
+
+// Parse one "word: count" line. The key must be a cleaned word and nothing
+// but whitespace may follow the count, so headers and lines such as
+// "Total Time: 0.099305 seconds" are rejected.
+int parseResultLine(const char* line, char* word, unsigned long long* count) {
+    size_t len = 0;
+    while (islower((unsigned char)line[len])) {
+        if (len == MAX_WORD_LEN - 1) return 0;
+        word[len] = line[len];
+        len++;
+    }
+    if (len == 0 || line[len] != ':' || line[len + 1] != ' ' || !isdigit((unsigned char)line[len + 2])) return 0;
+    word[len] = '\0';
+
+    char* end;
+    errno = 0;
+    *count = strtoull(line + len + 2, &end, 10);
+    if (errno != 0) return 0;
+    while (isspace((unsigned char)*end)) end++;
+    return *end == '\0';
+}
+
+// Load a result file, either binary or "word: count" text
+int loadResult(const char* filename) {
+    int status = loadBinaryResult(filename);
+    if (status <= 0) return status;
+
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return -1;
+    }
+    char line[256];
+    char word[MAX_WORD_LEN];
+    unsigned long long count;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (parseResultLine(line, word, &count)) {
+            addWordWithCount(&dictionary, word, count);
+            totalTokens += count;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+int compareByCountDesc(const void* a, const void* b) {
+    int ia = *(const int*)a, ib = *(const int*)b;
+    if (dictionary.counts[ia] != dictionary.counts[ib]) return dictionary.counts[ia] < dictionary.counts[ib] ? 1 : -1;
+    return strcmp(getWord(&dictionary, ia), getWord(&dictionary, ib));
+}
+
+void buildTopOrder(void) {
+    free(topOrder);
+    topOrder = malloc((dictionary.count ? dictionary.count : 1) * sizeof(int));
+    if (!topOrder) {
+        fprintf(stderr, "Memory allocation failed for top-N order\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < dictionary.count; i++) topOrder[i] = i;
+    qsort(topOrder, dictionary.count, sizeof(int), compareByCountDesc);
+    topOrderValid = 1;
+}
+
+// Write as much pending output as the socket takes without blocking
+int flushClient(Client* c) {
+    while (c->outPos < c->outLen) {
+        ssize_t n = write(c->fd, c->out + c->outPos, c->outLen - c->outPos);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        c->outPos += n;
+    }
+    c->outPos = c->outLen = 0;
+    return 0;
+}
+
+// Queue bytes behind the client's pending output
+int queueOutput(Client* c, const void* data, size_t len) {
+    if (c->outPos > 0 && c->outLen + len > c->outCap) {
+        memmove(c->out, c->out + c->outPos, c->outLen - c->outPos);
+        c->outLen -= c->outPos;
+        c->outPos = 0;
+    }
+    if (c->outLen + len > c->outCap) {
+        size_t newCap = c->outCap ? c->outCap : 8192;
+        while (newCap < c->outLen + len) newCap *= 2;
+        char* newOut = realloc(c->out, newCap);
+        if (!newOut) return -1;
+        c->out = newOut;
+        c->outCap = newCap;
+    }
+    memcpy(c->out + c->outLen, data, len);
+    c->outLen += len;
+    return 0;
+}
+
+// Queue a response and send what the socket takes now; poll drains the rest
+int sendResponse(Client* c, uint8_t status, const void* payload, uint32_t len) {
+    FrameHeader header = { status, {0, 0, 0}, len };
+    if (queueOutput(c, &header, sizeof(header)) < 0) return -1;
+    if (len && queueOutput(c, payload, len) < 0) return -1;
+    return flushClient(c);
+}
+
+// Count an OP_APPEND payload as the continuation of the client's text. The
+// token at the end of the frame may go on in the next one, so it is kept in
+// the client's tail; whole MAX_WORD_LEN - 1 chunks of it are counted already,
+// as fscanf("%99s") would cut them.
+uint64_t appendText(Client* c, const char* payload, size_t len) {
+    const char* text = payload;
+    char* joined = NULL;
+    if (c->tailLen > 0) {
+        joined = malloc(c->tailLen + len);
+        if (!joined) {
+            fprintf(stderr, "Memory allocation failed for appended text\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(joined, c->tail, c->tailLen);
+        memcpy(joined + c->tailLen, payload, len);
+        text = joined;
+        len += c->tailLen;
+    }
+    size_t cut = len;
+    while (cut > 0 && !isspace((unsigned char)text[cut - 1])) cut--;
+    cut += (len - cut) / (MAX_WORD_LEN - 1) * (MAX_WORD_LEN - 1);
+    uint64_t added = countText(&dictionary, text, cut);
+    c->tailLen = len - cut;
+    memcpy(c->tail, text + cut, c->tailLen);
+    free(joined);
+    return added;
+}
+
+// Count a disconnecting client's unfinished token and release its buffers
+void closeClient(Client* c) {
+    if (c->tailLen > 0) countText(&dictionary, c->tail, c->tailLen);
+    close(c->fd);
+    free(c->buf);
+    free(c->out);
+}
+
+// Look up a word exactly as a client sent it, after the same cleaning
+uint64_t lookupCount(const char* raw, size_t len) {
+    char word[MAX_WORD_LEN];
+    if (len >= MAX_WORD_LEN) return 0;
+    memcpy(word, raw, len);
+    word[len] = '\0';
+    cleanWord(word);
+    int idx = findWord(&dictionary, word);
+    return idx == -1 ? 0 : dictionary.counts[idx];
+}
+
+// Handle one complete request frame; returns -1 if the client should be dropped
+int handleRequest(Client* c, uint8_t op, const char* payload, uint32_t len) {
+    switch (op) {
+    case OP_LOOKUP: {
+        uint64_t count = lookupCount(payload, len);
+        return sendResponse(c, STATUS_OK, &count, sizeof(count));
+    }
+    case OP_BATCH: {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < len; i++) {
+            if (payload[i] == '\0') n++;
+        }
+        size_t outLen = sizeof(uint32_t) + n * sizeof(uint64_t);
+        char* out = malloc(outLen);
+        if (!out) return -1;
+        memcpy(out, &n, sizeof(n));
+        uint64_t* counts = (uint64_t*)(out + sizeof(uint32_t));
+        uint32_t k = 0, start = 0;
+        for (uint32_t i = 0; i < len; i++) {
+            if (payload[i] == '\0') {
+                uint64_t c = lookupCount(payload + start, i - start);
+                memcpy(&counts[k++], &c, sizeof(c));
+                start = i + 1;
+            }
+        }
+        int rc = sendResponse(c, STATUS_OK, out, (uint32_t)outLen);
+        free(out);
+        return rc;
+    }
+    case OP_TOPN: {
+        uint32_t n;
+        if (len != sizeof(n)) return sendResponse(c, STATUS_BAD_REQUEST, NULL, 0);
+        memcpy(&n, payload, sizeof(n));
+        if (n > (uint32_t)dictionary.count) n = dictionary.count;
+        if (!topOrderValid) buildTopOrder();
+
+        size_t outLen = sizeof(uint32_t);
+        for (uint32_t i = 0; i < n; i++) {
+            outLen += sizeof(uint64_t) + sizeof(uint16_t) + strlen(getWord(&dictionary, topOrder[i]));
+        }
+        char* out = malloc(outLen);
+        if (!out) return -1;
+        char* p = out;
+        memcpy(p, &n, sizeof(n));
+        p += sizeof(n);
+        for (uint32_t i = 0; i < n; i++) {
+            const char* word = getWord(&dictionary, topOrder[i]);
+            uint64_t count = dictionary.counts[topOrder[i]];
+            uint16_t wlen = (uint16_t)strlen(word);
+            memcpy(p, &count, sizeof(count));
+            p += sizeof(count);
+            memcpy(p, &wlen, sizeof(wlen));
+            p += sizeof(wlen);
+            memcpy(p, word, wlen);
+            p += wlen;
+        }
+        int rc = sendResponse(c, STATUS_OK, out, (uint32_t)outLen);
+        free(out);
+        return rc;
+    }
+    case OP_APPEND: {
+        uint64_t added = appendText(c, payload, len);
+        return sendResponse(c, STATUS_OK, &added, sizeof(added));
+    }
+    case OP_STATS: {
+        uint64_t stats[2] = { (uint64_t)dictionary.count, totalTokens };
+        return sendResponse(c, STATUS_OK, stats, sizeof(stats));
+    }
+    default:
+        return sendResponse(c, STATUS_BAD_REQUEST, NULL, 0);
+    }
+}
+
+// Read whatever is available and handle every complete frame in the buffer
+int serviceClient(Client* c) {
+    if (c->cap - c->len < 4096) {
+        size_t newCap = c->cap ? c->cap * 2 : 8192;
+        char* newBuf = realloc(c->buf, newCap);
+        if (!newBuf) return -1;
+        c->buf = newBuf;
+        c->cap = newCap;
+    }
+    ssize_t n = read(c->fd, c->buf + c->len, c->cap - c->len);
+    if (n <= 0) {
+        return (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    c->len += n;
+
+    size_t pos = 0;
+    while (c->len - pos >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        memcpy(&header, c->buf + pos, sizeof(header));
+        if (header.len > MAX_FRAME_LEN) return -1;
+        if (c->len - pos < sizeof(header) + header.len) break;
+        if (handleRequest(c, header.op, c->buf + pos + sizeof(header), header.len) < 0) return -1;
+        pos += sizeof(header) + header.len;
+    }
+    memmove(c->buf, c->buf + pos, c->len - pos);
+    c->len -= pos;
+    return 0;
+}
+
+int openListenSocket(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    const char* socketPath = DEFAULT_SOCKET_PATH;
+    const char* inputFile = "input.txt";
+    const char* resultFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            resultFile = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--socket PATH] [--input FILE | --load RESULT_FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    initWordList(&dictionary, 4096);
+    if (resultFile ? loadResult(resultFile) : buildFromText(inputFile)) {
+        freeWordList(&dictionary);
+        return 1;
+    }
+    printf("Loaded %d unique words (%llu tokens) from '%s'\n",
+           dictionary.count, (unsigned long long)totalTokens, resultFile ? resultFile : inputFile);
+
+    int listenFd = openListenSocket(socketPath);
+    if (listenFd < 0) {
+        freeWordList(&dictionary);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving on '%s'\n", socketPath);
+    fflush(stdout);
+
+    Client clients[MAX_CLIENTS];
+    int numClients = 0;
+    struct pollfd fds[MAX_CLIENTS + 1];
+
+    while (running) {
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        // A client that is not reading its responses gets no more requests
+        // handled until its backlog drains, so it cannot hold up the others
+        for (int i = 0; i < numClients; i++) {
+            size_t pending = clients[i].outLen - clients[i].outPos;
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = (pending < MAX_PENDING_OUTPUT ? POLLIN : 0) | (pending > 0 ? POLLOUT : 0);
+        }
+        if (poll(fds, numClients + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // Service existing clients first; dropped ones are swapped with the last entry
+        for (int i = numClients - 1; i >= 0; i--) {
+            short revents = fds[i + 1].revents;
+            if (revents == 0) continue;
+            int rc = 0;
+            if (revents & POLLOUT) rc = flushClient(&clients[i]);
+            if (rc == 0 && (revents & (POLLIN | POLLHUP | POLLERR))) rc = serviceClient(&clients[i]);
+            if (rc < 0) {
+                closeClient(&clients[i]);
+                clients[i] = clients[--numClients];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0) {
+                if (numClients < MAX_CLIENTS && fcntl(fd, F_SETFL, O_NONBLOCK) == 0) {
+                    memset(&clients[numClients], 0, sizeof(Client));
+                    clients[numClients].fd = fd;
+                    numClients++;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < numClients; i++) {
+        closeClient(&clients[i]);
+    }
+    printf("Shutting down: %d unique words, %llu tokens\n",
+           dictionary.count, (unsigned long long)totalTokens);
+    close(listenFd);
+    unlink(socketPath);
+    free(topOrder);
+    freeWordList(&dictionary);
+    return 0;
+}
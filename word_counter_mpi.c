@@ -1,22 +1,108 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/perf_event.h>
 #include <mpi.h>
 
 #define MAX_WORD_LEN 100
+#define BASE_PAGE_SIZE 4096UL
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define HUGE_TLB_START HUGE_PAGE_SIZE   // bytes a hugetlb column or key pool starts at
+#define INITIAL_SLOT_WORDS 1024   // words the slot index is first sized for
+#define MAX_MESSAGE_BYTES (1 << 30)     // largest single message; bigger payloads go in pieces
+#define SAMPLE_BLOCK 8192   // input bytes per sampling block in approximate mode
+#define HLL_BITS 12         // 4096 HyperLogLog registers, about 1.6% standard error
+#define MAX_PROBE_BATCH 64
+#define DEFAULT_PROBE_BATCH 16
 
+// Per-thread arena for dictionary memory. Every column, key pool and slot
+// index is its own anonymous mapping, reserved up front from the input size
+// with MAP_NORESERVE so only touched pages cost memory, and grown with mremap,
+// which moves page tables instead of copying data. Mappings of at least one
+// huge page use hugetlb pages when the kernel has some reserved and are
+// advised for transparent huge pages otherwise.
 typedef struct {
-    char word[MAX_WORD_LEN];
-    int count;
-} WordCount;
+    int hugeTlb;            // -1 until the first huge mapping is tried, then 1 if hugetlb worked
+    size_t reserved;        // address space currently mapped
+    size_t peakReserved;    // highest reserved
+    size_t inUse;           // bytes of dictionary data, as of the last sync
+    size_t committed;       // inUse rounded up to whole pages of each mapping
+    size_t peak;            // highest inUse
+    size_t peakCommitted;   // highest committed
+    long growthEvents;      // mappings grown and slot indexes rebuilt
+    long copies;            // growths that had to copy because mremap failed
+    long mappings;
+    long hugeTlbMappings;
+    long thpMappings;
+} Arena;
 
+// Structure-of-arrays dictionary: hashes, key references and counts live in
+// separate columns, so the columns can be handed to MPI as they are
 typedef struct {
-    WordCount* words;
-    int count;
-    int capacity;
+    uint64_t* hashes;       // hash of each word
+    size_t* keyOffsets;     // offset of each word in keyPool
+    uint64_t* counts;       // occurrences of each word
+    int count;              // number of unique words
+    int capacity;           // current capacity of the columns
+    char* keyPool;          // NUL-terminated words stored back to back
+    size_t keyPoolUsed;
+    size_t keyPoolCapacity;
+    int* slots;             // open-addressing index into the columns, -1 if empty
+    int slotCapacity;       // always a power of two
+    Arena* arena;           // arena that owns the mappings below
+    size_t columnBytes;     // size of each column mapping
+    size_t slotBytes;       // size of the slot index mapping
+    size_t usedBytes;       // usage last reported to the arena
+    size_t committedBytes;
 } WordList;
 
+// Words waiting for a WordList probe. Each word's home slot is prefetched
+// when it is queued and the column entries the slots point at are prefetched
+// before the batch is probed, so the cache misses of a batch overlap instead
+// of stalling one lookup at a time
+typedef struct {
+    const char* words[MAX_PROBE_BATCH];
+    uint64_t hashes[MAX_PROBE_BATCH];
+    int count;
+    int size;           // words per batch, at most MAX_PROBE_BATCH
+} ProbeBatch;
+
+// Hardware counter profiling (--profile): every thread opens its own
+// perf_event_open counters and charges them to the phase it is in, so the
+// totals can be summed over threads and ranks. Counters the kernel refuses
+// (no PMU, perf_event_paranoid, containers) stay closed and print as n/a.
+enum { PHASE_NONE = -1, PHASE_READ, PHASE_TOKENIZE, PHASE_COUNT, PHASE_MERGE, PHASE_COMMUNICATE, NUM_PHASES };
+enum { EVENT_CYCLES, EVENT_INSTRUCTIONS, EVENT_LLC_MISSES, EVENT_BRANCH_MISSES, EVENT_DTLB_MISSES, NUM_EVENTS };
+
+const char* phaseNames[NUM_PHASES] = { "read", "tokenize", "count", "merge", "communicate" };
+
+typedef struct {
+    int enabled;
+    int fds[NUM_EVENTS];            // -1 if the counter could not be opened
+    int openErrno;                  // errno of the first failed perf_event_open
+    int phase;                      // phase being charged, PHASE_NONE between phases
+    double last[NUM_EVENTS + 1];    // counter values and time at the last switch
+    double totals[NUM_PHASES][NUM_EVENTS + 1];  // the last column is seconds
+} PhaseProfile;
+
+// Phase totals summed over profiles
+typedef struct {
+    double totals[NUM_PHASES][NUM_EVENTS + 1];
+    int available[NUM_EVENTS];      // 1 if every profile had the counter
+    int openErrno;
+    int profiles;                   // one per rank
+} ProfileReport;
+
 // Clean word by removing punctuation and converting to lowercase
 void cleanWord(char* word) {
     int i, j = 0;
@@ -30,52 +116,942 @@ void cleanWord(char* word) {
     strcpy(word, temp);
 }
 
+// Read the whole input file into one NUL-terminated buffer (caller frees)
+char* readFile(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror("Error opening file");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* buffer = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (!buffer || fread(buffer, 1, (size_t)length, file) != (size_t)length) {
+        fprintf(stderr, "Failed to read %s\n", filename);
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    buffer[length] = '\0';
+    *size = (size_t)length;
+    return buffer;
+}
+
+// Approximate mode (--sample=RATE): only a pseudo-random RATE share of the
+// SAMPLE_BLOCK-byte blocks of the input, chosen by block number, is tokenized
+// and counted, and the final counts are scaled back up by 1/RATE. A token
+// belongs to the block its run of non-space characters starts in. Distinct
+// words are estimated with a HyperLogLog sketch fed by hllScan, a lighter
+// pass over all of the input.
+int blockSampled(long long block, double rate) {
+    if (rate >= 1.0) return 1;
+    uint64_t x = (uint64_t)block * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    return (double)(x >> 11) / 9007199254740992.0 < rate;
+}
+
+// Split a buffer into cleaned words and append them to a growing word array.
+// Tokens are cut exactly like fscanf("%99s"): runs of non-space characters,
+// split every MAX_WORD_LEN - 1 characters. With a rate below 1 the bytes of
+// unsampled blocks are skipped. Returns -1 if the array cannot grow.
+int tokenizeBuffer(const char* buffer, size_t size, double rate, char (**words)[MAX_WORD_LEN], int* count, int* capacity) {
+    char tempWord[MAX_WORD_LEN];
+    size_t pos = 0;
+    while (pos < size) {
+        while (pos < size && isspace((unsigned char)buffer[pos])) pos++;
+        if (pos == size) break;
+        if (rate < 1.0 && !blockSampled(pos / SAMPLE_BLOCK, rate)) {
+            // Jump to the next sampled block and past any run started before it
+            long long block = pos / SAMPLE_BLOCK + 1;
+            while ((size_t)block * SAMPLE_BLOCK < size && !blockSampled(block, rate)) block++;
+            pos = (size_t)block * SAMPLE_BLOCK;
+            while (pos < size && !isspace((unsigned char)buffer[pos - 1]) && !isspace((unsigned char)buffer[pos])) pos++;
+            continue;
+        }
+        do {
+            int len = 0;
+            while (pos < size && len < MAX_WORD_LEN - 1 && !isspace((unsigned char)buffer[pos])) {
+                tempWord[len++] = buffer[pos++];
+            }
+            tempWord[len] = '\0';
+            cleanWord(tempWord);
+            if (tempWord[0] == '\0') continue;
+            if (*count >= *capacity) {
+                int newCapacity = *capacity * 2;
+                char (*newWords)[MAX_WORD_LEN] = realloc(*words, newCapacity * sizeof(**words));
+                if (!newWords) {
+                    fprintf(stderr, "Memory reallocation failed for allWords\n");
+                    return -1;
+                }
+                *words = newWords;
+                *capacity = newCapacity;
+            }
+            strcpy((*words)[(*count)++], tempWord);
+        } while (pos < size && !isspace((unsigned char)buffer[pos]));
+    }
+    return 0;
+}
+
+// FNV-1a hash of a cleaned word
+uint64_t hashWord(const char* word) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *word; word++) {
+        h ^= (unsigned char)*word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void initArena(Arena* arena) {
+    memset(arena, 0, sizeof(*arena));
+    arena->hugeTlb = -1;
+}
+
+size_t roundToPage(size_t bytes, size_t page) {
+    return (bytes + page - 1) & ~(page - 1);
+}
+
+// Page size backing a mapping of the given size
+size_t mappingPage(const Arena* arena, size_t mapped) {
+    return arena->hugeTlb == 1 && mapped >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : BASE_PAGE_SIZE;
+}
+
+// Find out once whether the arena can map hugetlb pages
+int arenaHugeTlb(Arena* arena) {
+    if (arena->hugeTlb == -1) {
+        void* probe = mmap(NULL, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        arena->hugeTlb = probe != MAP_FAILED;
+        if (probe != MAP_FAILED) munmap(probe, HUGE_PAGE_SIZE);
+    }
+    return arena->hugeTlb;
+}
+
+// Map at least bytes of address space; returns the mapping and its size in *mapped
+void* arenaMap(Arena* arena, size_t bytes, size_t* mapped) {
+    void* base = MAP_FAILED;
+    if (arena->hugeTlb != 0 && bytes >= HUGE_PAGE_SIZE) {
+        // hugetlb pages come out of the reserved pool at map time, so no
+        // MAP_NORESERVE; initWordList keeps these mappings to realistic sizes
+        size_t hugeBytes = roundToPage(bytes, HUGE_PAGE_SIZE);
+        base = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            bytes = hugeBytes;
+            arena->hugeTlb = 1;
+            arena->hugeTlbMappings++;
+        } else if (arena->hugeTlb == -1) {
+            arena->hugeTlb = 0;
+        }
+    }
+    if (base == MAP_FAILED) {
+        bytes = roundToPage(bytes, BASE_PAGE_SIZE);
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "Memory mapping failed for WordList\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (bytes >= HUGE_PAGE_SIZE && madvise(base, bytes, MADV_HUGEPAGE) == 0) arena->thpMappings++;
+    }
+    arena->reserved += bytes;
+    if (arena->reserved > arena->peakReserved) arena->peakReserved = arena->reserved;
+    arena->mappings++;
+    *mapped = bytes;
+    return base;
+}
+
+void arenaUnmap(Arena* arena, void* base, size_t mapped) {
+    munmap(base, mapped);
+    arena->reserved -= mapped;
+}
+
+// Grow a mapping to at least bytes, keeping its contents; *mapped is updated
+void* arenaGrow(Arena* arena, void* base, size_t* mapped, size_t bytes) {
+    arena->growthEvents++;
+    // Round as arenaMap would, so a copied mapping ends up the same size as a remapped one
+    size_t newMapped = roundToPage(bytes, bytes >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : BASE_PAGE_SIZE);
+    void* grown = mremap(base, *mapped, newMapped, MREMAP_MAYMOVE);
+    if (grown != MAP_FAILED) {
+        arena->reserved += newMapped - *mapped;
+        if (arena->reserved > arena->peakReserved) arena->peakReserved = arena->reserved;
+        *mapped = newMapped;
+        return grown;
+    }
+    // Some kernels refuse to remap hugetlb mappings; fall back to a copy
+    size_t copyMapped;
+    grown = arenaMap(arena, newMapped, &copyMapped);
+    memcpy(grown, base, *mapped);
+    arenaUnmap(arena, base, *mapped);
+    arena->copies++;
+    *mapped = copyMapped;
+    return grown;
+}
+
+// Sum the statistics of one arena into total
+void addArenaStats(Arena* total, const Arena* arena) {
+    total->reserved += arena->reserved;
+    total->peakReserved += arena->peakReserved;
+    total->inUse += arena->inUse;
+    total->committed += arena->committed;
+    total->peak += arena->peak;
+    total->peakCommitted += arena->peakCommitted;
+    total->growthEvents += arena->growthEvents;
+    total->copies += arena->copies;
+    total->mappings += arena->mappings;
+    total->hugeTlbMappings += arena->hugeTlbMappings;
+    total->thpMappings += arena->thpMappings;
+}
+
+// Waste is memory the dictionaries touched but do not use: the unfilled tail of each page.
+// Peaks are summed per arena and need not coincide, so they bound the real peak from above.
+void printArenaStats(const Arena* total, int arenas) {
+    const double mb = 1024.0 * 1024.0;
+    printf("Arenas: %d, %ld mappings (%ld hugetlb, %ld THP), sum of per-arena peaks %.1f MB reserved / "
+           "%.1f MB in use / %.1f MB waste, %ld growth events (%ld copied)\n",
+           arenas, total->mappings, total->hugeTlbMappings, total->thpMappings, total->peakReserved / mb,
+           total->peak / mb, (total->peakCommitted - total->peak) / mb, total->growthEvents, total->copies);
+}
+
+// Sum the arena statistics of every rank into total on rank 0
+void reduceArenaStats(const Arena* local, Arena* total) {
+    unsigned long long fields[11] = {
+        local->reserved, local->peakReserved, local->inUse, local->committed, local->peak, local->peakCommitted,
+        local->growthEvents, local->copies, local->mappings, local->hugeTlbMappings, local->thpMappings
+    };
+    unsigned long long sums[11];
+    MPI_Reduce(fields, sums, 11, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    initArena(total);
+    total->reserved = sums[0];
+    total->peakReserved = sums[1];
+    total->inUse = sums[2];
+    total->committed = sums[3];
+    total->peak = sums[4];
+    total->peakCommitted = sums[5];
+    total->growthEvents = sums[6];
+    total->copies = sums[7];
+    total->mappings = sums[8];
+    total->hugeTlbMappings = sums[9];
+    total->thpMappings = sums[10];
+}
+
 // WordList handling functions
-void initWordList(WordList* list, int capacity) {
-    list->words = malloc(capacity * sizeof(WordCount));
-    list->count = 0;
-    list->capacity = capacity;
+
+// Bring the arena's usage figures up to date with a WordList; released
+// lists count as empty. Called on growth and when the list is freed, which
+// keeps the per-word path free of bookkeeping.
+void syncArenaUsage(WordList* list, int released) {
+    Arena* arena = list->arena;
+    size_t used = 0, committed = 0;
+    if (!released) {
+        size_t columnUsed = (size_t)list->count * sizeof(uint64_t);
+        size_t slotUsed = (size_t)list->slotCapacity * sizeof(int);
+        used = 3 * columnUsed + list->keyPoolUsed + slotUsed;
+        committed = 3 * roundToPage(columnUsed, mappingPage(arena, list->columnBytes)) +
+                    roundToPage(list->keyPoolUsed, mappingPage(arena, list->keyPoolCapacity)) +
+                    roundToPage(slotUsed, mappingPage(arena, list->slotBytes));
+    }
+    arena->inUse += used - list->usedBytes;
+    arena->committed += committed - list->committedBytes;
+    list->usedBytes = used;
+    list->committedBytes = committed;
+    if (arena->inUse > arena->peak) arena->peak = arena->inUse;
+    if (arena->committed > arena->peakCommitted) arena->peakCommitted = arena->committed;
 }
 
+// Initialize an empty WordList in arena with room for maxWords words and
+// maxKeyBytes bytes of keys; both still grow if the estimate is short
+void initWordList(WordList* list, Arena* arena, size_t maxWords, size_t maxKeyBytes) {
+    memset(list, 0, sizeof(*list));
+    list->arena = arena;
+    if (maxWords < 16) maxWords = 16;
+    if (maxWords > INT_MAX / 4) maxWords = INT_MAX / 4;
+    if (maxKeyBytes < MAX_WORD_LEN) maxKeyBytes = MAX_WORD_LEN;
+    // The estimates are upper bounds. Base page mappings only reserve address
+    // space for them, but hugetlb ones would commit pool pages, so with
+    // hugetlb the columns and key pool start at HUGE_TLB_START and grow
+    if (arenaHugeTlb(arena)) {
+        if (maxWords > HUGE_TLB_START / sizeof(uint64_t)) maxWords = HUGE_TLB_START / sizeof(uint64_t);
+        if (maxKeyBytes > HUGE_TLB_START) maxKeyBytes = HUGE_TLB_START;
+    }
+    list->hashes = arenaMap(arena, maxWords * sizeof(uint64_t), &list->columnBytes);
+    list->keyOffsets = arenaMap(arena, list->columnBytes, &list->columnBytes);
+    list->counts = arenaMap(arena, list->columnBytes, &list->columnBytes);
+    list->capacity = (int)(list->columnBytes / sizeof(uint64_t));
+    list->keyPool = arenaMap(arena, maxKeyBytes, &list->keyPoolCapacity);
+
+    // The index starts small and doubles as words arrive, so a generous
+    // estimate does not cost a sparse table
+    size_t startWords = maxWords < INITIAL_SLOT_WORDS ? maxWords : INITIAL_SLOT_WORDS;
+    list->slotCapacity = 1;
+    while ((size_t)list->slotCapacity < startWords * 2) list->slotCapacity <<= 1;
+    list->slots = arenaMap(arena, list->slotCapacity * sizeof(int), &list->slotBytes);
+    memset(list->slots, -1, list->slotCapacity * sizeof(int));
+    syncArenaUsage(list, 0);
+}
+
+// Return a WordList's mappings to its arena
 void freeWordList(WordList* list) {
-    if (list->words) free(list->words);
-    list->count = 0;
-    list->capacity = 0;
+    Arena* arena = list->arena;
+    if (!arena) return;
+    syncArenaUsage(list, 0);
+    syncArenaUsage(list, 1);
+    arenaUnmap(arena, list->hashes, list->columnBytes);
+    arenaUnmap(arena, list->keyOffsets, list->columnBytes);
+    arenaUnmap(arena, list->counts, list->columnBytes);
+    arenaUnmap(arena, list->keyPool, list->keyPoolCapacity);
+    arenaUnmap(arena, list->slots, list->slotBytes);
+    memset(list, 0, sizeof(*list));
+}
+
+// Word stored at index i of a WordList
+const char* getWord(const WordList* list, int i) {
+    return list->keyPool + list->keyOffsets[i];
+}
+
+// Rebuild the index at twice the size from the stored hashes
+void growSlots(WordList* list) {
+    int newSlotCapacity = list->slotCapacity * 2;
+    size_t newSlotBytes;
+    int* newSlots = arenaMap(list->arena, newSlotCapacity * sizeof(int), &newSlotBytes);
+    memset(newSlots, -1, newSlotCapacity * sizeof(int));
+    for (int i = 0; i < list->count; i++) {
+        int s = (int)(list->hashes[i] & (newSlotCapacity - 1));
+        while (newSlots[s] != -1) s = (s + 1) & (newSlotCapacity - 1);
+        newSlots[s] = i;
+    }
+    arenaUnmap(list->arena, list->slots, list->slotBytes);
+    list->arena->growthEvents++;
+    list->slots = newSlots;
+    list->slotBytes = newSlotBytes;
+    list->slotCapacity = newSlotCapacity;
 }
 
-void ensureCapacity(WordList* list) {
+// Make room for one more word of length wordLen in WordList. Columns and keys
+// are extended in place or moved by mremap, so existing keys are never copied
+void ensureCapacity(WordList* list, size_t wordLen) {
     if (list->count >= list->capacity) {
-        list->capacity *= 2;
-        list->words = realloc(list->words, list->capacity * sizeof(WordCount));
+        size_t bytes = list->columnBytes * 2;
+        size_t mapped = list->columnBytes;
+        list->hashes = arenaGrow(list->arena, list->hashes, &mapped, bytes);
+        mapped = list->columnBytes;
+        list->keyOffsets = arenaGrow(list->arena, list->keyOffsets, &mapped, bytes);
+        mapped = list->columnBytes;
+        list->counts = arenaGrow(list->arena, list->counts, &mapped, bytes);
+        list->columnBytes = mapped;
+        list->capacity = (int)(mapped / sizeof(uint64_t));
     }
+    if (list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity) {
+        list->keyPool = arenaGrow(list->arena, list->keyPool, &list->keyPoolCapacity,
+                                  list->keyPoolCapacity * 2 + wordLen + 1);
+    }
+    if (list->count * 2 >= list->slotCapacity) {
+        growSlots(list);
+    }
+    syncArenaUsage(list, 0);
 }
 
-// Add word, increment count by 1 if exists, else add new
-void addWordToList(WordList* list, const char* word) {
-    for (int i = 0; i < list->count; i++) {
-        if (strcmp(list->words[i].word, word) == 0) {
-            list->words[i].count++;
+// Add word with a precomputed hash and a given count in a given WordList
+void addWordWithHash(WordList* list, const char* word, uint64_t hash, uint64_t count) {
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) {
+            list->counts[i] += count;  // if the word already exists in the list
             return;
         }
+        s = (s + 1) & mask;
+    }
+    // Add new word if not exists with the given count
+    size_t wordLen = strlen(word);
+    if (list->count >= list->capacity || list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity ||
+        list->count * 2 >= list->slotCapacity) {
+        ensureCapacity(list, wordLen);
+        mask = list->slotCapacity - 1;
+        s = (int)(hash & mask);
+        while (list->slots[s] != -1) s = (s + 1) & mask;
     }
-    ensureCapacity(list);
-    strcpy(list->words[list->count].word, word);
-    list->words[list->count].count = 1;
+    list->slots[s] = list->count;
+    list->hashes[list->count] = hash;
+    list->keyOffsets[list->count] = list->keyPoolUsed;
+    list->counts[list->count] = count;
+    memcpy(list->keyPool + list->keyPoolUsed, word, wordLen + 1);
+    list->keyPoolUsed += wordLen + 1;
     list->count++;
 }
 
-// NEW: Add word with specified count (for merging)
-void addWordCountToList(WordList* list, const char* word, int count) {
+// Add word with a given count in a given WordList
+void addWordWithCount(WordList* list, const char* word, uint64_t count) {
+    addWordWithHash(list, word, hashWord(word), count);
+}
+
+// Add word in a given WordList
+void addWordToList(WordList* list, const char* word) {
+    addWordWithCount(list, word, 1);
+}
+
+void initProbeBatch(ProbeBatch* batch, int size) {
+    batch->count = 0;
+    batch->size = size;
+}
+
+// Probe every queued word: prefetch the hash, key offset and count behind
+// each word's home slot for the whole batch, then insert or increment
+void drainProbeBatch(ProbeBatch* batch, WordList* list) {
+    int mask = list->slotCapacity - 1;
+    for (int k = 0; k < batch->count; k++) {
+        int i = list->slots[batch->hashes[k] & mask];
+        if (i >= 0) {
+            __builtin_prefetch(&list->hashes[i]);
+            __builtin_prefetch(&list->keyOffsets[i]);
+            __builtin_prefetch(&list->counts[i], 1);
+        }
+    }
+    for (int k = 0; k < batch->count; k++) {
+        int i = list->slots[batch->hashes[k] & mask];
+        if (i >= 0) __builtin_prefetch(list->keyPool + list->keyOffsets[i]);
+    }
+    for (int k = 0; k < batch->count; k++) {
+        addWordWithHash(list, batch->words[k], batch->hashes[k], 1);
+    }
+    batch->count = 0;
+}
+
+// Queue one occurrence of a word; the word must stay in place until the batch is drained
+void queueProbe(ProbeBatch* batch, WordList* list, const char* word, uint64_t hash) {
+    __builtin_prefetch(&list->slots[hash & (list->slotCapacity - 1)]);
+    batch->words[batch->count] = word;
+    batch->hashes[batch->count] = hash;
+    if (++batch->count == batch->size) drainProbeBatch(batch, list);
+}
+
+int profiling = 0;  // set by --profile
+
+int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);  // this thread, any CPU
+}
+
+// Current counter values, scaled up when the kernel multiplexed them, and the time
+void readCounters(const PhaseProfile* p, double* values) {
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        uint64_t data[3];   // value, time enabled, time running
+        values[e] = 0.0;
+        if (p->fds[e] >= 0 && read(p->fds[e], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+            values[e] = (double)data[0] * ((double)data[1] / data[2]);
+        }
+    }
+    values[NUM_EVENTS] = MPI_Wtime();
+}
+
+// Open the calling thread's counters; does nothing without --profile
+void startProfile(PhaseProfile* p) {
+    static const uint32_t types[NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    static const uint64_t configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,     // last-level cache misses on most CPUs
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+    memset(p, 0, sizeof(*p));
+    p->phase = PHASE_NONE;
+    if (!profiling) return;
+    p->enabled = 1;
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        p->fds[e] = openCounter(types[e], configs[e]);
+        if (p->fds[e] < 0 && !p->openErrno) p->openErrno = errno;
+    }
+    readCounters(p, p->last);
+}
+
+// Charge everything since the last switch to the current phase, then start charging phase
+void switchPhase(PhaseProfile* p, int phase) {
+    if (!p->enabled) return;
+    double now[NUM_EVENTS + 1];
+    readCounters(p, now);
+    if (p->phase != PHASE_NONE) {
+        for (int e = 0; e <= NUM_EVENTS; e++) p->totals[p->phase][e] += now[e] - p->last[e];
+    }
+    memcpy(p->last, now, sizeof(now));
+    p->phase = phase;
+}
+
+void stopProfile(PhaseProfile* p) {
+    if (!p->enabled) return;
+    switchPhase(p, PHASE_NONE);
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (p->fds[e] >= 0) close(p->fds[e]);
+    }
+}
+
+void initProfileReport(ProfileReport* r) {
+    memset(r, 0, sizeof(*r));
+    for (int e = 0; e < NUM_EVENTS; e++) r->available[e] = 1;
+}
+
+void addToReport(ProfileReport* r, const PhaseProfile* p) {
+    if (!p->enabled) return;
+    for (int ph = 0; ph < NUM_PHASES; ph++) {
+        for (int e = 0; e <= NUM_EVENTS; e++) r->totals[ph][e] += p->totals[ph][e];
+    }
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (p->fds[e] < 0) r->available[e] = 0;
+    }
+    if (!r->openErrno) r->openErrno = p->openErrno;
+    r->profiles++;
+}
+
+// Misses per thousand instructions, or n/a
+void printMpki(const ProfileReport* r, const double* row, int event) {
+    if (r->available[event] && r->available[EVENT_INSTRUCTIONS] && row[EVENT_INSTRUCTIONS] > 0.0) {
+        printf(" %11.3f", 1000.0 * row[event] / row[EVENT_INSTRUCTIONS]);
+    } else {
+        printf(" %11s", "n/a");
+    }
+}
+
+void printProfile(const ProfileReport* r) {
+    printf("\nPhase profile (summed over %d profiles", r->profiles);
+    int any = 0;
+    for (int e = 0; e < NUM_EVENTS; e++) any |= r->available[e];
+    if (!any) printf("; hardware counters unavailable: %s%s", strerror(r->openErrno),
+                     r->openErrno == EACCES || r->openErrno == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+    printf(")\n");
+    printf("%-12s %10s %12s %12s %6s %11s %11s %11s\n", "Phase", "Seconds", "Mcycles", "Minstr", "IPC",
+           "LLC MPKI", "Branch MPKI", "dTLB MPKI");
+    double sum[NUM_EVENTS + 1] = {0};
+    for (int ph = 0; ph <= NUM_PHASES; ph++) {
+        const double* row = ph < NUM_PHASES ? r->totals[ph] : sum;
+        if (ph < NUM_PHASES) {
+            if (row[NUM_EVENTS] <= 0.0) continue;
+            for (int e = 0; e <= NUM_EVENTS; e++) sum[e] += row[e];
+        }
+        printf("%-12s %10.6f", ph < NUM_PHASES ? phaseNames[ph] : "total", row[NUM_EVENTS]);
+        for (int e = EVENT_CYCLES; e <= EVENT_INSTRUCTIONS; e++) {
+            if (r->available[e]) printf(" %12.3f", row[e] / 1e6);
+            else printf(" %12s", "n/a");
+        }
+        if (r->available[EVENT_CYCLES] && r->available[EVENT_INSTRUCTIONS] && row[EVENT_CYCLES] > 0.0) {
+            printf(" %6.2f", row[EVENT_INSTRUCTIONS] / row[EVENT_CYCLES]);
+        } else {
+            printf(" %6s", "n/a");
+        }
+        printMpki(r, row, EVENT_LLC_MISSES);
+        printMpki(r, row, EVENT_BRANCH_MISSES);
+        printMpki(r, row, EVENT_DTLB_MISSES);
+        printf("\n");
+    }
+}
+
+PhaseProfile mainProfile;   // this rank's counters
+
+// Packed dictionary sent between ranks by the tree reduction: a PackedHeader,
+// then the hash and count columns, then the keys back to back, all sorted by
+// key so two packed dictionaries merge in one linear pass
+typedef struct {
+    uint64_t count;         // number of words
+    uint64_t keyBytes;      // size of the key blob
+} PackedHeader;
+
+size_t packedSize(uint64_t count, uint64_t keyBytes) {
+    return sizeof(PackedHeader) + count * 2 * sizeof(uint64_t) + keyBytes;
+}
+
+// Column and key pointers into a packed dictionary
+void packedColumns(char* packed, uint64_t** hashes, uint64_t** counts, char** keys) {
+    PackedHeader* header = (PackedHeader*)packed;
+    *hashes = (uint64_t*)(packed + sizeof(PackedHeader));
+    *counts = *hashes + header->count;
+    *keys = (char*)(*counts + header->count);
+}
+
+char* allocPacked(uint64_t count, uint64_t keyBytes) {
+    char* packed = malloc(packedSize(count, keyBytes));
+    if (!packed) {
+        fprintf(stderr, "Memory allocation failed for packed dictionary\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    PackedHeader* header = (PackedHeader*)packed;
+    header->count = count;
+    header->keyBytes = keyBytes;
+    return packed;
+}
+
+const WordList* sortList = NULL;   // list being ordered by compareKeys
+
+int compareKeys(const void* a, const void* b) {
+    return strcmp(getWord(sortList, *(const int*)a), getWord(sortList, *(const int*)b));
+}
+
+// Serialize a WordList into a packed dictionary sorted by key
+char* packWordList(const WordList* list) {
+    int* order = malloc((list->count > 0 ? list->count : 1) * sizeof(int));
+    if (!order) {
+        fprintf(stderr, "Memory allocation failed for sort order\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < list->count; i++) order[i] = i;
+    sortList = list;
+    qsort(order, list->count, sizeof(int), compareKeys);
+
+    char* packed = allocPacked(list->count, list->keyPoolUsed);
+    uint64_t *hashes, *counts;
+    char* keys;
+    packedColumns(packed, &hashes, &counts, &keys);
     for (int i = 0; i < list->count; i++) {
-        if (strcmp(list->words[i].word, word) == 0) {
-            list->words[i].count += count;
-            return;
+        const char* word = getWord(list, order[i]);
+        size_t len = strlen(word) + 1;
+        hashes[i] = list->hashes[order[i]];
+        counts[i] = list->counts[order[i]];
+        memcpy(keys, word, len);
+        keys += len;
+    }
+    free(order);
+    return packed;
+}
+
+// Merge two packed dictionaries into a new one, summing counts of equal keys
+char* mergePacked(char* a, char* b) {
+    PackedHeader* ha = (PackedHeader*)a;
+    PackedHeader* hb = (PackedHeader*)b;
+    char* out = allocPacked(ha->count + hb->count, ha->keyBytes + hb->keyBytes);
+    uint64_t *aHashes, *aCounts, *bHashes, *bCounts, *oHashes, *oCounts;
+    char *aKey, *bKey, *oKey;
+    packedColumns(a, &aHashes, &aCounts, &aKey);
+    packedColumns(b, &bHashes, &bCounts, &bKey);
+    packedColumns(out, &oHashes, &oCounts, &oKey);
+    char* keysStart = oKey;
+
+    uint64_t i = 0, j = 0, n = 0;
+    while (i < ha->count || j < hb->count) {
+        int cmp = i == ha->count ? 1 : j == hb->count ? -1 : strcmp(aKey, bKey);
+        const char* word;
+        if (cmp <= 0) {
+            word = aKey;
+            oHashes[n] = aHashes[i];
+            oCounts[n] = aCounts[i];
+            if (cmp == 0) {
+                oCounts[n] += bCounts[j++];
+                bKey += strlen(bKey) + 1;
+            }
+            aKey += strlen(aKey) + 1;
+            i++;
+        } else {
+            word = bKey;
+            oHashes[n] = bHashes[j];
+            oCounts[n] = bCounts[j];
+            bKey += strlen(bKey) + 1;
+            j++;
         }
+        size_t len = strlen(word) + 1;
+        memcpy(oKey, word, len);
+        oKey += len;
+        n++;
     }
-    ensureCapacity(list);
-    strcpy(list->words[list->count].word, word);
-    list->words[list->count].count = count;
-    list->count++;
+
+    // Shared keys leave the output shorter than allocated; close the gap
+    // between the columns and the keys
+    PackedHeader* ho = (PackedHeader*)out;
+    uint64_t keyBytes = oKey - keysStart;
+    memmove(oHashes + n, oCounts, n * sizeof(uint64_t));
+    memmove(oHashes + 2 * n, keysStart, keyBytes);
+    ho->count = n;
+    ho->keyBytes = keyBytes;
+    return out;
+}
+
+// Send a packed dictionary as its size followed by pieces of at most
+// MAX_MESSAGE_BYTES, since MPI counts are ints and dictionaries can pass 2 GiB
+void sendPacked(const char* packed, int dest) {
+    const PackedHeader* header = (const PackedHeader*)packed;
+    uint64_t bytes = packedSize(header->count, header->keyBytes);
+    MPI_Send(&bytes, 1, MPI_UINT64_T, dest, 0, MPI_COMM_WORLD);
+    for (uint64_t sent = 0; sent < bytes; sent += MAX_MESSAGE_BYTES) {
+        uint64_t piece = bytes - sent < MAX_MESSAGE_BYTES ? bytes - sent : MAX_MESSAGE_BYTES;
+        MPI_Send(packed + sent, (int)piece, MPI_BYTE, dest, 0, MPI_COMM_WORLD);
+    }
+}
+
+// Receive a dictionary sent by sendPacked (caller frees)
+char* recvPacked(int source) {
+    uint64_t bytes;
+    MPI_Recv(&bytes, 1, MPI_UINT64_T, source, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    char* packed = malloc(bytes);
+    if (!packed) {
+        fprintf(stderr, "Memory allocation failed for received dictionary\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (uint64_t received = 0; received < bytes; received += MAX_MESSAGE_BYTES) {
+        uint64_t piece = bytes - received < MAX_MESSAGE_BYTES ? bytes - received : MAX_MESSAGE_BYTES;
+        MPI_Recv(packed + received, (int)piece, MPI_BYTE, source, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    return packed;
+}
+
+// Binomial-tree reduction of packed dictionaries: in round k every rank with
+// bit k set sends its dictionary to rank - 2^k and drops out, so merges run
+// in parallel over ceil(log2(size)) rounds and rank 0 does only the last one.
+// levelTimes[k] gets the time this rank spent in round k.
+char* treeReduce(char* packed, int rank, int size, double* levelTimes) {
+    int level = 0;
+    for (int step = 1; step < size; step <<= 1, level++) {
+        double levelStart = MPI_Wtime();
+        if (rank & step) {
+            switchPhase(&mainProfile, PHASE_COMMUNICATE);
+            sendPacked(packed, rank - step);
+            free(packed);
+            levelTimes[level] = MPI_Wtime() - levelStart;
+            return NULL;
+        }
+        if (rank + step < size) {
+            switchPhase(&mainProfile, PHASE_COMMUNICATE);
+            char* received = recvPacked(rank + step);
+            switchPhase(&mainProfile, PHASE_MERGE);
+            char* merged = mergePacked(packed, received);
+            free(packed);
+            free(received);
+            packed = merged;
+        }
+        levelTimes[level] = MPI_Wtime() - levelStart;
+    }
+    return packed;
+}
+
+// Load a packed dictionary into an empty WordList
+void unpackToWordList(char* packed, WordList* list) {
+    PackedHeader* header = (PackedHeader*)packed;
+    uint64_t *hashes, *counts;
+    char* key;
+    packedColumns(packed, &hashes, &counts, &key);
+    for (uint64_t i = 0; i < header->count; i++) {
+        addWordWithHash(list, key, hashes[i], counts[i]);
+        key += strlen(key) + 1;
+    }
+}
+
+// Gather every rank's dictionary on rank 0 and merge them there one by one
+void gatherToRoot(WordList* localList, WordList* globalList, int rank, int size) {
+    // The key pool, hash column and count column are sent as they are;
+    // rank 0 needs the number of words and key bytes from every process
+    int local_sizes[2] = { localList->count, (int)localList->keyPoolUsed };
+
+    int* recv_sizes = NULL; // unique words and key bytes per process
+    if (rank == 0) {
+        recv_sizes = malloc(2 * size * sizeof(int));
+    }
+
+    switchPhase(&mainProfile, PHASE_COMMUNICATE);
+
+    MPI_Gather(local_sizes, 2, MPI_INT, recv_sizes, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // Calculate receive displacements for keys and columns on rank 0
+    int* recv_counts = NULL;  // number of unique words per process
+    int* key_bytes = NULL;    // key pool bytes to receive per process
+    int* key_displs = NULL;
+    int* count_displs = NULL;
+
+    char* all_keys = NULL;
+    uint64_t* all_hashes = NULL;
+    uint64_t* all_counts = NULL;
+    int totalCollectedWords = 0;
+
+    if (rank == 0) {
+        recv_counts = malloc(size * sizeof(int));
+        key_bytes = malloc(size * sizeof(int));
+        key_displs = malloc(size * sizeof(int));
+        count_displs = malloc(size * sizeof(int));
+
+        int offset_keys = 0;
+        for (int i = 0; i < size; i++) {
+            recv_counts[i] = recv_sizes[2 * i];
+            key_bytes[i] = recv_sizes[2 * i + 1];
+            key_displs[i] = offset_keys;
+            count_displs[i] = totalCollectedWords;
+            offset_keys += key_bytes[i];
+            totalCollectedWords += recv_counts[i];
+        }
+
+        all_keys = malloc(offset_keys > 0 ? offset_keys : 1);
+        all_hashes = malloc((totalCollectedWords > 0 ? totalCollectedWords : 1) * sizeof(uint64_t));
+        all_counts = malloc((totalCollectedWords > 0 ? totalCollectedWords : 1) * sizeof(uint64_t));
+        if (!all_keys || !all_hashes || !all_counts) {
+            fprintf(stderr, "Memory allocation failed for gathered words\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    MPI_Gatherv(localList->keyPool, local_sizes[1], MPI_CHAR,
+                all_keys, key_bytes, key_displs, MPI_CHAR,
+                0, MPI_COMM_WORLD);
+
+    MPI_Gatherv(localList->hashes, local_sizes[0], MPI_UINT64_T,
+                all_hashes, recv_counts, count_displs, MPI_UINT64_T,
+                0, MPI_COMM_WORLD);
+
+    MPI_Gatherv(localList->counts, local_sizes[0], MPI_UINT64_T,
+                all_counts, recv_counts, count_displs, MPI_UINT64_T,
+                0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        // Keys arrive back to back in the same order as their hashes and counts
+        switchPhase(&mainProfile, PHASE_MERGE);
+        const char* key = all_keys;
+        for (int i = 0; i < totalCollectedWords; i++) {
+            addWordWithHash(globalList, key, all_hashes[i], all_counts[i]);
+            key += strlen(key) + 1;
+        }
+
+        free(recv_sizes);
+        free(recv_counts);
+        free(key_bytes);
+        free(key_displs);
+        free(count_displs);
+        free(all_keys);
+        free(all_hashes);
+        free(all_counts);
+    }
+}
+
+// Record one word hash in a HyperLogLog register array
+void hllAdd(uint8_t* registers, uint64_t hash) {
+    // FNV-1a mixes its high bits poorly, so finalize before splitting the hash
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    uint64_t index = hash >> (64 - HLL_BITS);
+    uint64_t rest = hash << HLL_BITS;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - HLL_BITS + 1);
+    if (rank > registers[index]) registers[index] = rank;
+}
+
+// Feed every token whose run starts in buffer[from, to) into a HyperLogLog
+// sketch. This is the one pass approximate mode makes over all of the input,
+// so tokens are hashed in place, as hashWord would hash them once cleaned,
+// without being copied or stored.
+void hllScan(uint8_t* registers, const char* buffer, size_t size, size_t from, size_t to) {
+    // Classify bytes once: ' ' for spaces, the lowercase letter, or 1 for other characters
+    unsigned char classes[256];
+    for (int c = 0; c < 256; c++) {
+        classes[c] = isspace(c) ? ' ' : isalpha(c) ? (unsigned char)tolower(c) : 1;
+    }
+    const unsigned char* bytes = (const unsigned char*)buffer;
+    size_t pos = from;
+    while (pos > 0 && pos < size && classes[bytes[pos - 1]] != ' ' && classes[bytes[pos]] != ' ') pos++;
+    while (pos < to) {
+        while (pos < size && classes[bytes[pos]] == ' ') pos++;
+        if (pos >= to) break;
+        do {
+            uint64_t h = 1469598103934665603ULL;
+            int len = 0, letters = 0;
+            while (pos < size && len < MAX_WORD_LEN - 1 && classes[bytes[pos]] != ' ') {
+                unsigned char c = classes[bytes[pos++]];
+                len++;
+                if (c > 1) {
+                    h ^= c;
+                    h *= 1099511628211ULL;
+                    letters = 1;
+                }
+            }
+            if (letters) hllAdd(registers, h);
+        } while (pos < size && classes[bytes[pos]] != ' ');
+    }
+}
+
+double hllEstimate(const uint8_t* registers) {
+    const int m = 1 << HLL_BITS;
+    double sum = 0.0;
+    int zeros = 0;
+    for (int i = 0; i < m; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        if (registers[i] == 0) zeros++;
+    }
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * (double)m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log((double)m / zeros);   // linear counting for small sets
+    }
+    return estimate;
+}
+
+// Scale sampled counts back up to whole-input estimates
+void scaleCounts(WordList* list, double rate) {
+    if (rate >= 1.0) return;
+    for (int i = 0; i < list->count; i++) {
+        list->counts[i] = (uint64_t)(list->counts[i] / rate + 0.5);
+    }
+}
+
+// Binary result file: a ResultHeader, the count column, count + 1 key offsets
+// and the key blob, sorted by key so readers can mmap the file and
+// binary-search it without parsing. Key i is the NUL-terminated string at
+// offsets[i] in the blob.
+typedef struct {
+    char magic[4];          // "WCB1"
+    uint32_t version;
+    uint64_t count;         // number of words
+    uint64_t keyBytes;      // size of the key blob
+    uint64_t totalTokens;   // sum of all counts
+} ResultHeader;
+
+// Background writer; takes ownership of the final WordList and frees it
+typedef struct {
+    WordList list;
+    const char* filename;
+    int failed;
+} ResultWriter;
+
+void* writeResultFile(void* arg) {
+    ResultWriter* writer = arg;
+    WordList* list = &writer->list;
+    int n = list->count;
+    int* order = malloc((n > 0 ? n : 1) * sizeof(int));
+    uint64_t* column = malloc(((size_t)n + 1) * sizeof(uint64_t));
+    FILE* file = fopen(writer->filename, "wb");
+    writer->failed = !order || !column || !file;
+
+    if (!writer->failed) {
+        for (int i = 0; i < n; i++) order[i] = i;
+        sortList = list;
+        qsort(order, n, sizeof(int), compareKeys);
+
+        ResultHeader header = { {'W', 'C', 'B', '1'}, 1, (uint64_t)n, list->keyPoolUsed, 0 };
+        for (int i = 0; i < n; i++) header.totalTokens += list->counts[i];
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (int i = 0; i < n; i++) column[i] = list->counts[order[i]];
+        fwrite(column, sizeof(uint64_t), n, file);
+
+        uint64_t offset = 0;
+        for (int i = 0; i < n; i++) {
+            column[i] = offset;
+            offset += strlen(getWord(list, order[i])) + 1;
+        }
+        column[n] = offset;
+        fwrite(column, sizeof(uint64_t), (size_t)n + 1, file);
+
+        for (int i = 0; i < n; i++) {
+            const char* word = getWord(list, order[i]);
+            fwrite(word, 1, strlen(word) + 1, file);
+        }
+        writer->failed = ferror(file) != 0;
+    }
+    if (file && fclose(file) != 0) writer->failed = 1;
+    free(order);
+    free(column);
+    freeWordList(list);
+    return NULL;
 }
 
 int main(int argc, char** argv) {
@@ -84,39 +1060,74 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
+    // --reduce=tree merges dictionaries in a binomial tree instead of on rank 0
+    int useTree = 0;
+    double sampleRate = 1.0;    // --sample=RATE counts only that share of the input
+    int textOutput = 0;         // --text also prints the counts and saves them as text
+    int batchSize = DEFAULT_PROBE_BATCH;    // --batch=N probes N words at a time, 1 disables batching
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reduce=tree") == 0) {
+            useTree = 1;
+        } else if (strcmp(argv[i], "--reduce=gather") == 0) {
+            useTree = 0;
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sampleRate = atof(argv[i] + 9);
+        } else if (strcmp(argv[i], "--text") == 0) {
+            textOutput = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profiling = 1;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batchSize = atoi(argv[i] + 8);
+        } else {
+            if (rank == 0) fprintf(stderr, "Usage: %s [--reduce=gather|tree] [--sample=RATE] [--batch=N] [--text] [--profile]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (batchSize < 1 || batchSize > MAX_PROBE_BATCH) {
+        if (rank == 0) fprintf(stderr, "Batch size must be between 1 and %d\n", MAX_PROBE_BATCH);
+        MPI_Finalize();
+        return 1;
+    }
+    if (sampleRate <= 0.0 || sampleRate > 1.0) {
+        if (rank == 0) fprintf(stderr, "Sample rate must be in (0, 1]\n");
+        MPI_Finalize();
+        return 1;
+    }
+    int approximate = sampleRate < 1.0;
+
     char (*allWords)[MAX_WORD_LEN] = NULL;
     int totalWords = 0;
+    unsigned long long inputSize = 0;
 
     double start_time, end_time;
+    double hll_time = 0.0;  // time of the full-input HyperLogLog pass in approximate mode
 
+    startProfile(&mainProfile);
+    char* input = NULL;     // kept on rank 0 until the HyperLogLog pass
+    size_t inputBytes = 0;
     if (rank == 0) {
-        FILE* file = fopen("input.txt", "r");
-        if (!file) {
-            perror("Error opening file");
+        switchPhase(&mainProfile, PHASE_READ);
+        input = readFile("input.txt", &inputBytes);
+        if (!input) {
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        inputSize = inputBytes;
 
+        switchPhase(&mainProfile, PHASE_TOKENIZE);
         int capacity = 10000;
         allWords = malloc(capacity * sizeof(*allWords));
-        char tempWord[MAX_WORD_LEN];
-
-        while (fscanf(file, "%99s", tempWord) == 1) {
-            cleanWord(tempWord);
-            if (strlen(tempWord) > 0) {
-                if (totalWords >= capacity) {
-                    capacity *= 2;
-                    allWords = realloc(allWords, capacity * sizeof(*allWords));
-                }
-                strcpy(allWords[totalWords++], tempWord);
-            }
+        if (!allWords || tokenizeBuffer(input, inputBytes, sampleRate, &allWords, &totalWords, &capacity) < 0) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
-        fclose(file);
     }
 
-    // Broadcast totalWords to all processes
+    // Broadcast totalWords and the input size, which bounds the dictionaries, to all processes
+    switchPhase(&mainProfile, PHASE_COMMUNICATE);
     MPI_Bcast(&totalWords, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&inputSize, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
 
-    // Distribute words evenly among processes
+    // Distribute the (sampled) words evenly among processes
     int chunkSize = totalWords / size;
     int remainder = totalWords % size;
     int localSize = (rank < remainder) ? chunkSize + 1 : chunkSize;
@@ -153,112 +1164,150 @@ int main(int argc, char** argv) {
 
     start_time = MPI_Wtime();
 
+    // Only rank 0 holds the whole input, so it alone feeds the HyperLogLog sketch
+    uint8_t hll[1 << HLL_BITS] = {0};
+    if (rank == 0 && approximate) {
+        switchPhase(&mainProfile, PHASE_TOKENIZE);
+        hllScan(hll, input, inputBytes, 0, inputBytes);
+        hll_time = MPI_Wtime() - start_time;
+    }
+    free(input);
+
     // Local word count
+    switchPhase(&mainProfile, PHASE_COUNT);
+    // No list holds more words than tokens, nor more key bytes than the
+    // input plus one terminator per token
+    size_t maxKeyBytes = inputSize + totalWords;
+    size_t localKeyBytes = (size_t)localSize * MAX_WORD_LEN < maxKeyBytes ? (size_t)localSize * MAX_WORD_LEN : maxKeyBytes;
+    Arena arena, resultArena;     // the result list is freed by the writer thread, so it gets its own
+    initArena(&arena);
+    initArena(&resultArena);
     WordList localList;
-    initWordList(&localList, 1000);
+    initWordList(&localList, &arena, localSize, localKeyBytes);
+    ProbeBatch batch;
+    initProbeBatch(&batch, batchSize);
     for (int i = 0; i < localSize; i++) {
-        addWordToList(&localList, localWords[i]);
+        if (batchSize > 1) queueProbe(&batch, &localList, localWords[i], hashWord(localWords[i]));
+        else addWordToList(&localList, localWords[i]);
     }
+    drainProbeBatch(&batch, &localList);
 
-    // Prepare buffers for sending counts and words from all processes to rank 0
-    int local_count = localList.count;
+    int levels = 0;
+    while ((1 << levels) < size) levels++;
+    double* levelTimes = calloc(levels > 0 ? levels : 1, sizeof(double));
 
-    int* local_counts = malloc(local_count * sizeof(int));
-    char* local_words_flat = malloc(local_count * MAX_WORD_LEN);
-
-    for (int i = 0; i < local_count; i++) {
-        strcpy(&local_words_flat[i * MAX_WORD_LEN], localList.words[i].word);
-        local_counts[i] = localList.words[i].count;
-    }
-
-    int* recv_counts = NULL; // number of unique words per process
+    WordList globalList;
     if (rank == 0) {
-        recv_counts = malloc(size * sizeof(int));
+        initWordList(&globalList, &resultArena, totalWords, maxKeyBytes);
     }
 
-    MPI_Gather(&local_count, 1, MPI_INT, recv_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    // Calculate receive displacements for words and counts on rank 0
-    int* word_counts_sizes = NULL; // counts of chars to receive per process
-    int* word_displs = NULL;
-    int* count_displs = NULL;
-
-    char* all_words_flat = NULL;
-    int* all_counts = NULL;
-    int totalCollectedWords = 0;
-
-    if (rank == 0) {
-        word_counts_sizes = malloc(size * sizeof(int));
-        word_displs = malloc(size * sizeof(int));
-        count_displs = malloc(size * sizeof(int));
-
-        int offset_words = 0;
-        int offset_counts = 0;
-        for (int i = 0; i < size; i++) {
-            totalCollectedWords += recv_counts[i];
-            word_counts_sizes[i] = recv_counts[i] * MAX_WORD_LEN;
-            word_displs[i] = offset_words;
-            count_displs[i] = offset_counts;
-            offset_words += word_counts_sizes[i];
-            offset_counts += recv_counts[i];
+    if (useTree) {
+        switchPhase(&mainProfile, PHASE_MERGE);
+        char* packed = treeReduce(packWordList(&localList), rank, size, levelTimes);
+        if (rank == 0) {
+            switchPhase(&mainProfile, PHASE_MERGE);
+            unpackToWordList(packed, &globalList);
+            free(packed);
         }
-
-        all_words_flat = malloc(offset_words * sizeof(char));
-        all_counts = malloc(offset_counts * sizeof(int));
+    } else {
+        gatherToRoot(&localList, &globalList, rank, size);
     }
 
-    MPI_Gatherv(local_words_flat, local_count * MAX_WORD_LEN, MPI_CHAR,
-                all_words_flat, word_counts_sizes, word_displs, MPI_CHAR,
-                0, MPI_COMM_WORLD);
-
-    MPI_Gatherv(local_counts, local_count, MPI_INT,
-                all_counts, recv_counts, count_displs, MPI_INT,
-                0, MPI_COMM_WORLD);
+    if (approximate && rank == 0) {
+        switchPhase(&mainProfile, PHASE_MERGE);
+        scaleCounts(&globalList, sampleRate);
+    }
+    stopProfile(&mainProfile);
 
     end_time = MPI_Wtime();
 
-    if (rank == 0) {
-        WordList globalList;
-        initWordList(&globalList, 1000);
+    // Phase profile summed over all ranks
+    ProfileReport report;
+    if (profiling) {
+        ProfileReport local;
+        initProfileReport(&local);
+        addToReport(&local, &mainProfile);
+        initProfileReport(&report);
+        MPI_Reduce(local.totals, report.totals, NUM_PHASES * (NUM_EVENTS + 1), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(local.available, report.available, NUM_EVENTS, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&local.openErrno, &report.openErrno, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&local.profiles, &report.profiles, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
 
-        for (int i = 0; i < totalCollectedWords; i++) {
-            addWordCountToList(&globalList, &all_words_flat[i * MAX_WORD_LEN], all_counts[i]);
-        }
+    // Arena statistics summed over all ranks, taken while every list is alive
+    syncArenaUsage(&localList, 0);
+    if (rank == 0) syncArenaUsage(&globalList, 0);
+    Arena rankArenas, arenaTotal;
+    initArena(&rankArenas);
+    addArenaStats(&rankArenas, &arena);
+    addArenaStats(&rankArenas, &resultArena);
+    reduceArenaStats(&rankArenas, &arenaTotal);
 
-        printf("Word Frequencies:\n");
-        for (int i = 0; i < globalList.count; i++) {
-            printf("%s: %d\n", globalList.words[i].word, globalList.words[i].count);
+    // Slowest rank in each tree round
+    double* maxLevelTimes = calloc(levels > 0 ? levels : 1, sizeof(double));
+    if (useTree && levels > 0) {
+        MPI_Reduce(levelTimes, maxLevelTimes, levels, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+
+    ResultWriter writer = { {0}, "word_frequencies_mpi.wcb", 0 };
+    pthread_t writerThread;
+    int writerStarted = 0;
+    if (rank == 0) {
+        if (textOutput) {
+            printf("Word Frequencies:\n");
+            for (int i = 0; i < globalList.count; i++) {
+                printf("%s: %llu\n", getWord(&globalList, i), (unsigned long long)globalList.counts[i]);
+            }
         }
 
+        printf("Unique words: %d\n", globalList.count);
         printf("Execution Time: %f seconds\n", end_time - start_time);
+        if (approximate) {
+            printf("Sample rate: %g (counts scaled by %g)\n", sampleRate, 1.0 / sampleRate);
+            printf("Estimated distinct words (HyperLogLog): %.0f, sampled distinct words: %d\n",
+                   hllEstimate(hll), globalList.count);
+            printf("HyperLogLog pass over all %llu input bytes: %f seconds of the execution time\n",
+                   inputSize, hll_time);
+        }
+        if (useTree) {
+            for (int k = 0; k < levels; k++) {
+                printf("Tree level %d: %f seconds\n", k, maxLevelTimes[k]);
+            }
+        }
+        printArenaStats(&arenaTotal, size + 1);
+        if (profiling) printProfile(&report);
 
         // Save the output to a file after printing
+        if (textOutput) {
 FILE *file = fopen("word_frequencies_output_mpi.txt", "w");
 if (file != NULL) {
     fprintf(file, "Word Frequencies:\n");
     for (int i = 0; i < globalList.count; i++) {
-        fprintf(file, "%s: %d\n", globalList.words[i].word, globalList.words[i].count);
+        fprintf(file, "%s: %llu\n", getWord(&globalList, i), (unsigned long long)globalList.counts[i]);
     }
     fclose(file);
-    printf("Output saved to 'word_frequencies_output.txt'\n");
+    printf("Output saved to 'word_frequencies_output_mpi.txt'\n");
 } else {
     perror("Error opening file for writing");
 }
+        }
 
-
-        freeWordList(&globalList);
-        free(recv_counts);
-        free(word_counts_sizes);
-        free(word_displs);
-        free(count_displs);
-        free(all_words_flat);
-        free(all_counts);
+        // The binary result is written in the background while the ranks tear down
+        writer.list = globalList;
+        writerStarted = pthread_create(&writerThread, NULL, writeResultFile, &writer) == 0;
+        if (!writerStarted) writeResultFile(&writer);
     }
 
     freeWordList(&localList);
     free(localWords);
-    free(local_counts);
-    free(local_words_flat);
+    free(levelTimes);
+    free(maxLevelTimes);
+
+    if (writerStarted) pthread_join(writerThread, NULL);
+    if (rank == 0) {
+        if (writer.failed) perror("Error writing word_frequencies_mpi.wcb");
+        else printf("Results saved to 'word_frequencies_mpi.wcb'\n");
+    }
 
     MPI_Finalize();
     return 0;
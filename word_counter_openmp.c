@@ -1,23 +1,137 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/perf_event.h>
 #include <omp.h>
 
 #define MAX_WORD_LEN 100
+#define BASE_PAGE_SIZE 4096UL
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define HUGE_TLB_START HUGE_PAGE_SIZE   // bytes a hugetlb column or key pool starts at
+#define INITIAL_SLOT_WORDS 1024   // words the slot index is first sized for
 #define NUM_THREADS 8
+#define DEFAULT_HOT_CACHE_SLOTS 256
+#define HOT_CACHE_MAX_SCORE 8
+#define MAX_PROBE_BATCH 64
+#define DEFAULT_PROBE_BATCH 16
+#define SAMPLE_BLOCK 8192   // input bytes per sampling block in approximate mode
+#define HLL_BITS 12         // 4096 HyperLogLog registers, about 1.6% standard error
+#define MAX_STAGE_THREADS 16        // threads per pipeline stage
+#define DEFAULT_TOKENIZERS 2
+#define DEFAULT_COUNTERS 2
+#define RING_SIZE 16                // buffers in flight between two pipeline threads, a power of two
+#define READ_BLOCK (256 * 1024)     // bytes per pipeline input block
+#define TOKEN_BATCH 512             // words per batch handed to a counter
+#define SPIN_LIMIT 64               // empty polls before a waiting stage yields the CPU
 
+// Per-thread arena for dictionary memory. Every column, key pool and slot
+// index is its own anonymous mapping, reserved up front from the input size
+// with MAP_NORESERVE so only touched pages cost memory, and grown with mremap,
+// which moves page tables instead of copying data. Mappings of at least one
+// huge page use hugetlb pages when the kernel has some reserved and are
+// advised for transparent huge pages otherwise.
+typedef struct {
+    int hugeTlb;            // -1 until the first huge mapping is tried, then 1 if hugetlb worked
+    size_t reserved;        // address space currently mapped
+    size_t peakReserved;    // highest reserved
+    size_t inUse;           // bytes of dictionary data, as of the last sync
+    size_t committed;       // inUse rounded up to whole pages of each mapping
+    size_t peak;            // highest inUse
+    size_t peakCommitted;   // highest committed
+    long growthEvents;      // mappings grown and slot indexes rebuilt
+    long copies;            // growths that had to copy because mremap failed
+    long mappings;
+    long hugeTlbMappings;
+    long thpMappings;
+} Arena;
+
+// Structure-of-arrays dictionary: the hash, key reference and count of word i
+// live in separate columns so count-only passes and merges stream through
+// the columns without dragging the keys through cache
+typedef struct {
+    uint64_t* hashes;       // hash of each word
+    size_t* keyOffsets;     // offset of each word in keyPool
+    uint64_t* counts;       // occurrences of each word
+    int count;              // number of unique words
+    int capacity;           // current capacity of the columns
+    char* keyPool;          // NUL-terminated words stored back to back
+    size_t keyPoolUsed;
+    size_t keyPoolCapacity;
+    int* slots;             // open-addressing index into the columns, -1 if empty
+    int slotCapacity;       // always a power of two
+    Arena* arena;           // arena that owns the mappings below
+    size_t columnBytes;     // size of each column mapping
+    size_t slotBytes;       // size of the slot index mapping
+    size_t usedBytes;       // usage last reported to the arena
+    size_t committedBytes;
+} WordList;
+
+// Direct-mapped front cache of hot words; each slot batches the occurrences
+// of one word so frequent words skip the WordList lookup
 typedef struct {
     char word[MAX_WORD_LEN];
+    uint64_t hash;
+    uint64_t pending;   // occurrences not yet flushed to the WordList
+    int score;          // saturating hit counter, the slot is replaced when it drops to 0
+} HotCacheEntry;
+
+typedef struct {
+    HotCacheEntry* entries;
+    int mask;           // number of slots - 1, slots is a power of two
+    long long hits;
+    long long misses;
+    long long flushes;  // evictions that pushed pending counts to the WordList
+} HotCache;
+
+// Words waiting for a WordList probe. Each word's home slot is prefetched
+// when it is queued and the column entries the slots point at are prefetched
+// before the batch is probed, so the cache misses of a batch overlap instead
+// of stalling one lookup at a time
+typedef struct {
+    const char* words[MAX_PROBE_BATCH];
+    uint64_t hashes[MAX_PROBE_BATCH];
     int count;
-} WordCount;
+    int size;           // words per batch, at most MAX_PROBE_BATCH
+} ProbeBatch;
+
+// Hardware counter profiling (--profile): every thread opens its own
+// perf_event_open counters and charges them to the phase it is in, so the
+// totals can be summed over threads and ranks. Counters the kernel refuses
+// (no PMU, perf_event_paranoid, containers) stay closed and print as n/a.
+enum { PHASE_NONE = -1, PHASE_READ, PHASE_TOKENIZE, PHASE_COUNT, PHASE_MERGE, PHASE_COMMUNICATE, NUM_PHASES };
+enum { EVENT_CYCLES, EVENT_INSTRUCTIONS, EVENT_LLC_MISSES, EVENT_BRANCH_MISSES, EVENT_DTLB_MISSES, NUM_EVENTS };
+
+const char* phaseNames[NUM_PHASES] = { "read", "tokenize", "count", "merge", "communicate" };
 
 typedef struct {
-    WordCount* words;   // dynamically allocated array
-    int count;          // number of unique words
-    int capacity;       // current capacity of words array
-} WordList;
+    int enabled;
+    int fds[NUM_EVENTS];            // -1 if the counter could not be opened
+    int openErrno;                  // errno of the first failed perf_event_open
+    int phase;                      // phase being charged, PHASE_NONE between phases
+    double last[NUM_EVENTS + 1];    // counter values and time at the last switch
+    double totals[NUM_PHASES][NUM_EVENTS + 1];  // the last column is seconds
+} PhaseProfile;
+
+// Phase totals summed over profiles
+typedef struct {
+    double totals[NUM_PHASES][NUM_EVENTS + 1];
+    int available[NUM_EVENTS];      // 1 if every profile had the counter
+    int openErrno;
+    int profiles;                   // main thread, workers and stages alike
+} ProfileReport;
 
 // Dynamicarray for all words read from the file
 char (*allWords)[MAX_WORD_LEN] = NULL;
@@ -30,6 +144,16 @@ WordList threadWordLists[NUM_THREADS];        //One WordList per thread for para
 // Global WordList to hold merged results
 WordList globalWordList;
 
+Arena threadArenas[NUM_THREADS];    //One arena per thread, so growth never takes a lock
+Arena mainArena;                    //Arena for the merged results
+
+HotCache threadHotCaches[NUM_THREADS];        //One front cache per thread
+
+uint8_t threadHll[NUM_THREADS][1 << HLL_BITS]; //One HyperLogLog sketch per thread
+
+PhaseProfile mainProfile;                     //Counters of the main thread outside the parallel region
+PhaseProfile threadProfiles[NUM_THREADS];     //Counters of each thread inside it
+
 // Clean word by removing punctuation and converting to lowercase
 void cleanWord(char* word) {
     int i, j = 0;
@@ -43,175 +167,1352 @@ void cleanWord(char* word) {
     strcpy(word, temp);
 }
 
-// Initialize WordList with above capacity 1000
-void initWordList(WordList* list, int capacity) {
-    list->words = malloc(capacity * sizeof(WordCount));
-    if (!list->words) {
-        fprintf(stderr, "Memory allocation failed for WordList\n");
-        exit(EXIT_FAILURE);
+// Read the whole input file into one NUL-terminated buffer (caller frees)
+char* readFile(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror("Error opening file");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* buffer = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (!buffer || fread(buffer, 1, (size_t)length, file) != (size_t)length) {
+        fprintf(stderr, "Failed to read %s\n", filename);
+        free(buffer);
+        fclose(file);
+        return NULL;
     }
-    list->count = 0;
-    list->capacity = capacity;
+    fclose(file);
+    buffer[length] = '\0';
+    *size = (size_t)length;
+    return buffer;
 }
 
-// Free WordList memory
-void freeWordList(WordList* list) {
-    if (list->words) {
-        free(list->words);
-        list->words = NULL;
+// Approximate mode (--sample=RATE): only a pseudo-random RATE share of the
+// SAMPLE_BLOCK-byte blocks of the input, chosen by block number, is tokenized
+// and counted, and the final counts are scaled back up by 1/RATE. A token
+// belongs to the block its run of non-space characters starts in. Distinct
+// words are estimated with a HyperLogLog sketch fed by hllScan, a lighter
+// pass over all of the input.
+int blockSampled(long long block, double rate) {
+    if (rate >= 1.0) return 1;
+    uint64_t x = (uint64_t)block * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    return (double)(x >> 11) / 9007199254740992.0 < rate;
+}
+
+// Split a buffer into cleaned words and append them to a growing word array.
+// Tokens are cut exactly like fscanf("%99s"): runs of non-space characters,
+// split every MAX_WORD_LEN - 1 characters. With a rate below 1 the bytes of
+// unsampled blocks are skipped. Returns -1 if the array cannot grow.
+int tokenizeBuffer(const char* buffer, size_t size, double rate, char (**words)[MAX_WORD_LEN], int* count, int* capacity) {
+    char tempWord[MAX_WORD_LEN];
+    size_t pos = 0;
+    while (pos < size) {
+        while (pos < size && isspace((unsigned char)buffer[pos])) pos++;
+        if (pos == size) break;
+        if (rate < 1.0 && !blockSampled(pos / SAMPLE_BLOCK, rate)) {
+            // Jump to the next sampled block and past any run started before it
+            long long block = pos / SAMPLE_BLOCK + 1;
+            while ((size_t)block * SAMPLE_BLOCK < size && !blockSampled(block, rate)) block++;
+            pos = (size_t)block * SAMPLE_BLOCK;
+            while (pos < size && !isspace((unsigned char)buffer[pos - 1]) && !isspace((unsigned char)buffer[pos])) pos++;
+            continue;
+        }
+        do {
+            int len = 0;
+            while (pos < size && len < MAX_WORD_LEN - 1 && !isspace((unsigned char)buffer[pos])) {
+                tempWord[len++] = buffer[pos++];
+            }
+            tempWord[len] = '\0';
+            cleanWord(tempWord);
+            if (tempWord[0] == '\0') continue;
+            if (*count >= *capacity) {
+                int newCapacity = *capacity * 2;
+                char (*newWords)[MAX_WORD_LEN] = realloc(*words, newCapacity * sizeof(**words));
+                if (!newWords) {
+                    fprintf(stderr, "Memory reallocation failed for allWords\n");
+                    return -1;
+                }
+                *words = newWords;
+                *capacity = newCapacity;
+            }
+            strcpy((*words)[(*count)++], tempWord);
+        } while (pos < size && !isspace((unsigned char)buffer[pos]));
     }
-    list->count = 0;
-    list->capacity = 0;
+    return 0;
 }
 
-// ifcapacity for one more WordCount entry in WordList
-void ensureCapacity(WordList* list) {
-    if (list->count >= list->capacity) {
-        int newCapacity = list->capacity * 2;
-        WordCount* newWords = realloc(list->words, newCapacity * sizeof(WordCount));
-        if (!newWords) {
-            fprintf(stderr, "Memory reallocation failed\n");
-            freeWordList(list);
+// FNV-1a hash of a cleaned word
+uint64_t hashWord(const char* word) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *word; word++) {
+        h ^= (unsigned char)*word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void initArena(Arena* arena) {
+    memset(arena, 0, sizeof(*arena));
+    arena->hugeTlb = -1;
+}
+
+size_t roundToPage(size_t bytes, size_t page) {
+    return (bytes + page - 1) & ~(page - 1);
+}
+
+// Page size backing a mapping of the given size
+size_t mappingPage(const Arena* arena, size_t mapped) {
+    return arena->hugeTlb == 1 && mapped >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : BASE_PAGE_SIZE;
+}
+
+// Find out once whether the arena can map hugetlb pages
+int arenaHugeTlb(Arena* arena) {
+    if (arena->hugeTlb == -1) {
+        void* probe = mmap(NULL, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        arena->hugeTlb = probe != MAP_FAILED;
+        if (probe != MAP_FAILED) munmap(probe, HUGE_PAGE_SIZE);
+    }
+    return arena->hugeTlb;
+}
+
+// Map at least bytes of address space; returns the mapping and its size in *mapped
+void* arenaMap(Arena* arena, size_t bytes, size_t* mapped) {
+    void* base = MAP_FAILED;
+    if (arena->hugeTlb != 0 && bytes >= HUGE_PAGE_SIZE) {
+        // hugetlb pages come out of the reserved pool at map time, so no
+        // MAP_NORESERVE; initWordList keeps these mappings to realistic sizes
+        size_t hugeBytes = roundToPage(bytes, HUGE_PAGE_SIZE);
+        base = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            bytes = hugeBytes;
+            arena->hugeTlb = 1;
+            arena->hugeTlbMappings++;
+        } else if (arena->hugeTlb == -1) {
+            arena->hugeTlb = 0;
+        }
+    }
+    if (base == MAP_FAILED) {
+        bytes = roundToPage(bytes, BASE_PAGE_SIZE);
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "Memory mapping failed for WordList\n");
             exit(EXIT_FAILURE);
         }
-        list->words = newWords;
-        list->capacity = newCapacity;
+        if (bytes >= HUGE_PAGE_SIZE && madvise(base, bytes, MADV_HUGEPAGE) == 0) arena->thpMappings++;
     }
+    arena->reserved += bytes;
+    if (arena->reserved > arena->peakReserved) arena->peakReserved = arena->reserved;
+    arena->mappings++;
+    *mapped = bytes;
+    return base;
 }
 
-// Add word in a given WordList
-void addWordToList(WordList* list, const char* word) {
+void arenaUnmap(Arena* arena, void* base, size_t mapped) {
+    munmap(base, mapped);
+    arena->reserved -= mapped;
+}
+
+// Grow a mapping to at least bytes, keeping its contents; *mapped is updated
+void* arenaGrow(Arena* arena, void* base, size_t* mapped, size_t bytes) {
+    arena->growthEvents++;
+    // Round as arenaMap would, so a copied mapping ends up the same size as a remapped one
+    size_t newMapped = roundToPage(bytes, bytes >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : BASE_PAGE_SIZE);
+    void* grown = mremap(base, *mapped, newMapped, MREMAP_MAYMOVE);
+    if (grown != MAP_FAILED) {
+        arena->reserved += newMapped - *mapped;
+        if (arena->reserved > arena->peakReserved) arena->peakReserved = arena->reserved;
+        *mapped = newMapped;
+        return grown;
+    }
+    // Some kernels refuse to remap hugetlb mappings; fall back to a copy
+    size_t copyMapped;
+    grown = arenaMap(arena, newMapped, &copyMapped);
+    memcpy(grown, base, *mapped);
+    arenaUnmap(arena, base, *mapped);
+    arena->copies++;
+    *mapped = copyMapped;
+    return grown;
+}
+
+// Sum the statistics of one arena into total
+void addArenaStats(Arena* total, const Arena* arena) {
+    total->reserved += arena->reserved;
+    total->peakReserved += arena->peakReserved;
+    total->inUse += arena->inUse;
+    total->committed += arena->committed;
+    total->peak += arena->peak;
+    total->peakCommitted += arena->peakCommitted;
+    total->growthEvents += arena->growthEvents;
+    total->copies += arena->copies;
+    total->mappings += arena->mappings;
+    total->hugeTlbMappings += arena->hugeTlbMappings;
+    total->thpMappings += arena->thpMappings;
+}
+
+// Waste is memory the dictionaries touched but do not use: the unfilled tail of each page.
+// Peaks are summed per arena and need not coincide, so they bound the real peak from above.
+void printArenaStats(const Arena* total, int arenas) {
+    const double mb = 1024.0 * 1024.0;
+    printf("Arenas: %d, %ld mappings (%ld hugetlb, %ld THP), sum of per-arena peaks %.1f MB reserved / "
+           "%.1f MB in use / %.1f MB waste, %ld growth events (%ld copied)\n",
+           arenas, total->mappings, total->hugeTlbMappings, total->thpMappings, total->peakReserved / mb,
+           total->peak / mb, (total->peakCommitted - total->peak) / mb, total->growthEvents, total->copies);
+}
+
+// Bring the arena's usage figures up to date with a WordList; released
+// lists count as empty. Called on growth and when the list is freed, which
+// keeps the per-word path free of bookkeeping.
+void syncArenaUsage(WordList* list, int released) {
+    Arena* arena = list->arena;
+    size_t used = 0, committed = 0;
+    if (!released) {
+        size_t columnUsed = (size_t)list->count * sizeof(uint64_t);
+        size_t slotUsed = (size_t)list->slotCapacity * sizeof(int);
+        used = 3 * columnUsed + list->keyPoolUsed + slotUsed;
+        committed = 3 * roundToPage(columnUsed, mappingPage(arena, list->columnBytes)) +
+                    roundToPage(list->keyPoolUsed, mappingPage(arena, list->keyPoolCapacity)) +
+                    roundToPage(slotUsed, mappingPage(arena, list->slotBytes));
+    }
+    arena->inUse += used - list->usedBytes;
+    arena->committed += committed - list->committedBytes;
+    list->usedBytes = used;
+    list->committedBytes = committed;
+    if (arena->inUse > arena->peak) arena->peak = arena->inUse;
+    if (arena->committed > arena->peakCommitted) arena->peakCommitted = arena->committed;
+}
+
+// Initialize an empty WordList in arena with room for maxWords words and
+// maxKeyBytes bytes of keys; both still grow if the estimate is short
+void initWordList(WordList* list, Arena* arena, size_t maxWords, size_t maxKeyBytes) {
+    memset(list, 0, sizeof(*list));
+    list->arena = arena;
+    if (maxWords < 16) maxWords = 16;
+    if (maxWords > INT_MAX / 4) maxWords = INT_MAX / 4;
+    if (maxKeyBytes < MAX_WORD_LEN) maxKeyBytes = MAX_WORD_LEN;
+    // The estimates are upper bounds. Base page mappings only reserve address
+    // space for them, but hugetlb ones would commit pool pages, so with
+    // hugetlb the columns and key pool start at HUGE_TLB_START and grow
+    if (arenaHugeTlb(arena)) {
+        if (maxWords > HUGE_TLB_START / sizeof(uint64_t)) maxWords = HUGE_TLB_START / sizeof(uint64_t);
+        if (maxKeyBytes > HUGE_TLB_START) maxKeyBytes = HUGE_TLB_START;
+    }
+    list->hashes = arenaMap(arena, maxWords * sizeof(uint64_t), &list->columnBytes);
+    list->keyOffsets = arenaMap(arena, list->columnBytes, &list->columnBytes);
+    list->counts = arenaMap(arena, list->columnBytes, &list->columnBytes);
+    list->capacity = (int)(list->columnBytes / sizeof(uint64_t));
+    list->keyPool = arenaMap(arena, maxKeyBytes, &list->keyPoolCapacity);
+
+    // The index starts small and doubles as words arrive, so a generous
+    // estimate does not cost a sparse table
+    size_t startWords = maxWords < INITIAL_SLOT_WORDS ? maxWords : INITIAL_SLOT_WORDS;
+    list->slotCapacity = 1;
+    while ((size_t)list->slotCapacity < startWords * 2) list->slotCapacity <<= 1;
+    list->slots = arenaMap(arena, list->slotCapacity * sizeof(int), &list->slotBytes);
+    memset(list->slots, -1, list->slotCapacity * sizeof(int));
+    syncArenaUsage(list, 0);
+}
+
+// Return a WordList's mappings to its arena
+void freeWordList(WordList* list) {
+    Arena* arena = list->arena;
+    if (!arena) return;
+    syncArenaUsage(list, 0);
+    syncArenaUsage(list, 1);
+    arenaUnmap(arena, list->hashes, list->columnBytes);
+    arenaUnmap(arena, list->keyOffsets, list->columnBytes);
+    arenaUnmap(arena, list->counts, list->columnBytes);
+    arenaUnmap(arena, list->keyPool, list->keyPoolCapacity);
+    arenaUnmap(arena, list->slots, list->slotBytes);
+    memset(list, 0, sizeof(*list));
+}
+
+// Word stored at index i of a WordList
+const char* getWord(const WordList* list, int i) {
+    return list->keyPool + list->keyOffsets[i];
+}
+
+// Rebuild the index at twice the size from the stored hashes
+void growSlots(WordList* list) {
+    int newSlotCapacity = list->slotCapacity * 2;
+    size_t newSlotBytes;
+    int* newSlots = arenaMap(list->arena, newSlotCapacity * sizeof(int), &newSlotBytes);
+    memset(newSlots, -1, newSlotCapacity * sizeof(int));
     for (int i = 0; i < list->count; i++) {
-        if (strcmp(list->words[i].word, word) == 0) {
-            list->words[i].count++;  // if the word already exists in the list
+        int s = (int)(list->hashes[i] & (newSlotCapacity - 1));
+        while (newSlots[s] != -1) s = (s + 1) & (newSlotCapacity - 1);
+        newSlots[s] = i;
+    }
+    arenaUnmap(list->arena, list->slots, list->slotBytes);
+    list->arena->growthEvents++;
+    list->slots = newSlots;
+    list->slotBytes = newSlotBytes;
+    list->slotCapacity = newSlotCapacity;
+}
+
+// Make room for one more word of length wordLen in WordList. Columns and keys
+// are extended in place or moved by mremap, so existing keys are never copied
+void ensureCapacity(WordList* list, size_t wordLen) {
+    if (list->count >= list->capacity) {
+        size_t bytes = list->columnBytes * 2;
+        size_t mapped = list->columnBytes;
+        list->hashes = arenaGrow(list->arena, list->hashes, &mapped, bytes);
+        mapped = list->columnBytes;
+        list->keyOffsets = arenaGrow(list->arena, list->keyOffsets, &mapped, bytes);
+        mapped = list->columnBytes;
+        list->counts = arenaGrow(list->arena, list->counts, &mapped, bytes);
+        list->columnBytes = mapped;
+        list->capacity = (int)(mapped / sizeof(uint64_t));
+    }
+    if (list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity) {
+        list->keyPool = arenaGrow(list->arena, list->keyPool, &list->keyPoolCapacity,
+                                  list->keyPoolCapacity * 2 + wordLen + 1);
+    }
+    if (list->count * 2 >= list->slotCapacity) {
+        growSlots(list);
+    }
+    syncArenaUsage(list, 0);
+}
+
+// Add word with a precomputed hash and a given count in a given WordList
+void addWordWithHash(WordList* list, const char* word, uint64_t hash, uint64_t count) {
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) {
+            list->counts[i] += count;  // if the word already exists in the list
             return;
         }
+        s = (s + 1) & mask;
+    }
+    // Add new word if not exists with the given count
+    size_t wordLen = strlen(word);
+    if (list->count >= list->capacity || list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity ||
+        list->count * 2 >= list->slotCapacity) {
+        ensureCapacity(list, wordLen);
+        mask = list->slotCapacity - 1;
+        s = (int)(hash & mask);
+        while (list->slots[s] != -1) s = (s + 1) & mask;
     }
-    // Add new word if not exists and its count is 1
-    ensureCapacity(list);
-    strcpy(list->words[list->count].word, word);
-    list->words[list->count].count = 1;
+    list->slots[s] = list->count;
+    list->hashes[list->count] = hash;
+    list->keyOffsets[list->count] = list->keyPoolUsed;
+    list->counts[list->count] = count;
+    memcpy(list->keyPool + list->keyPoolUsed, word, wordLen + 1);
+    list->keyPoolUsed += wordLen + 1;
     list->count++;
 }
 
-// Merge a thread-local WordList into the global WordList
+// Add word with a given count in a given WordList
+void addWordWithCount(WordList* list, const char* word, uint64_t count) {
+    addWordWithHash(list, word, hashWord(word), count);
+}
+
+// Add word in a given WordList
+void addWordToList(WordList* list, const char* word) {
+    addWordWithCount(list, word, 1);
+}
+
+void initProbeBatch(ProbeBatch* batch, int size) {
+    batch->count = 0;
+    batch->size = size;
+}
+
+// Probe every queued word: prefetch the hash, key offset and count behind
+// each word's home slot for the whole batch, then insert or increment
+void drainProbeBatch(ProbeBatch* batch, WordList* list) {
+    int mask = list->slotCapacity - 1;
+    for (int k = 0; k < batch->count; k++) {
+        int i = list->slots[batch->hashes[k] & mask];
+        if (i >= 0) {
+            __builtin_prefetch(&list->hashes[i]);
+            __builtin_prefetch(&list->keyOffsets[i]);
+            __builtin_prefetch(&list->counts[i], 1);
+        }
+    }
+    for (int k = 0; k < batch->count; k++) {
+        int i = list->slots[batch->hashes[k] & mask];
+        if (i >= 0) __builtin_prefetch(list->keyPool + list->keyOffsets[i]);
+    }
+    for (int k = 0; k < batch->count; k++) {
+        addWordWithHash(list, batch->words[k], batch->hashes[k], 1);
+    }
+    batch->count = 0;
+}
+
+// Queue one occurrence of a word; the word must stay in place until the batch is drained
+void queueProbe(ProbeBatch* batch, WordList* list, const char* word, uint64_t hash) {
+    __builtin_prefetch(&list->slots[hash & (list->slotCapacity - 1)]);
+    batch->words[batch->count] = word;
+    batch->hashes[batch->count] = hash;
+    if (++batch->count == batch->size) drainProbeBatch(batch, list);
+}
+
+// Initialize a HotCache with slots rounded up to a power of two (0 disables it)
+void initHotCache(HotCache* cache, int slots) {
+    int n = 1;
+    while (n < slots) n <<= 1;
+    cache->entries = slots > 0 ? calloc(n, sizeof(HotCacheEntry)) : NULL;
+    if (slots > 0 && !cache->entries) {
+        fprintf(stderr, "Memory allocation failed for HotCache\n");
+        exit(EXIT_FAILURE);
+    }
+    cache->mask = n - 1;
+    cache->hits = cache->misses = cache->flushes = 0;
+}
+
+// Push every pending count in the cache to the WordList and free it
+void flushHotCache(HotCache* cache, WordList* list) {
+    if (!cache->entries) return;
+    for (int i = 0; i <= cache->mask; i++) {
+        if (cache->entries[i].pending > 0) {
+            addWordWithHash(list, cache->entries[i].word, cache->entries[i].hash, cache->entries[i].pending);
+        }
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+}
+
+// Count one word through the front cache: a hit is a single compare. A miss
+// goes to the WordList and wears down the occupant's score; once that reaches
+// 0 the occupant's pending count is flushed and the missing word takes the slot,
+// so a run of rare words cannot push a hot word out. With a batch, WordList
+// updates for missed words are queued instead of probed one at a time.
+void addWordCached(HotCache* cache, ProbeBatch* batch, WordList* list, const char* word) {
+    if (!cache->entries) {
+        if (batch) queueProbe(batch, list, word, hashWord(word));
+        else addWordToList(list, word);
+        return;
+    }
+    uint64_t hash = hashWord(word);
+    HotCacheEntry* e = &cache->entries[hash & cache->mask];
+    if (e->hash == hash && strcmp(e->word, word) == 0) {
+        e->pending++;
+        if (e->score < HOT_CACHE_MAX_SCORE) e->score++;
+        cache->hits++;
+        return;
+    }
+    cache->misses++;
+    if (--e->score > 0) {
+        if (batch) queueProbe(batch, list, word, hash);
+        else addWordWithHash(list, word, hash, 1);
+        return;
+    }
+    if (e->pending > 0) {
+        addWordWithHash(list, e->word, e->hash, e->pending);
+        cache->flushes++;
+    }
+    strcpy(e->word, word);
+    e->hash = hash;
+    e->pending = 1;
+    e->score = 1;
+}
+
+// Merge a thread-local WordList into the global WordList, reusing the stored hashes
 void mergeWordLists(WordList* dest, WordList* src) {
     for (int i = 0; i < src->count; i++) {
-        int found = 0;
-        for (int j = 0; j < dest->count; j++) {
-            if (strcmp(dest->words[j].word, src->words[i].word) == 0) {
-                dest->words[j].count += src->words[i].count;     // if the word is found globally already exits
-                found = 1;
-                break;
+        addWordWithHash(dest, getWord(src, i), src->hashes[i], src->counts[i]);
+    }
+}
+
+// Record one word hash in a HyperLogLog register array
+void hllAdd(uint8_t* registers, uint64_t hash) {
+    // FNV-1a mixes its high bits poorly, so finalize before splitting the hash
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    uint64_t index = hash >> (64 - HLL_BITS);
+    uint64_t rest = hash << HLL_BITS;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - HLL_BITS + 1);
+    if (rank > registers[index]) registers[index] = rank;
+}
+
+// Feed every token whose run starts in buffer[from, to) into a HyperLogLog
+// sketch. This is the one pass approximate mode makes over all of the input,
+// so tokens are hashed in place, as hashWord would hash them once cleaned,
+// without being copied or stored.
+void hllScan(uint8_t* registers, const char* buffer, size_t size, size_t from, size_t to) {
+    // Classify bytes once: ' ' for spaces, the lowercase letter, or 1 for other characters
+    unsigned char classes[256];
+    for (int c = 0; c < 256; c++) {
+        classes[c] = isspace(c) ? ' ' : isalpha(c) ? (unsigned char)tolower(c) : 1;
+    }
+    const unsigned char* bytes = (const unsigned char*)buffer;
+    size_t pos = from;
+    while (pos > 0 && pos < size && classes[bytes[pos - 1]] != ' ' && classes[bytes[pos]] != ' ') pos++;
+    while (pos < to) {
+        while (pos < size && classes[bytes[pos]] == ' ') pos++;
+        if (pos >= to) break;
+        do {
+            uint64_t h = 1469598103934665603ULL;
+            int len = 0, letters = 0;
+            while (pos < size && len < MAX_WORD_LEN - 1 && classes[bytes[pos]] != ' ') {
+                unsigned char c = classes[bytes[pos++]];
+                len++;
+                if (c > 1) {
+                    h ^= c;
+                    h *= 1099511628211ULL;
+                    letters = 1;
+                }
             }
+            if (letters) hllAdd(registers, h);
+        } while (pos < size && classes[bytes[pos]] != ' ');
+    }
+}
+
+double hllEstimate(const uint8_t* registers) {
+    const int m = 1 << HLL_BITS;
+    double sum = 0.0;
+    int zeros = 0;
+    for (int i = 0; i < m; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        if (registers[i] == 0) zeros++;
+    }
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * (double)m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log((double)m / zeros);   // linear counting for small sets
+    }
+    return estimate;
+}
+
+// Scale sampled counts back up to whole-input estimates
+void scaleCounts(WordList* list, double rate) {
+    if (rate >= 1.0) return;
+    for (int i = 0; i < list->count; i++) {
+        list->counts[i] = (uint64_t)(list->counts[i] / rate + 0.5);
+    }
+}
+
+int profiling = 0;  // set by --profile
+
+int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);  // this thread, any CPU
+}
+
+// Current counter values, scaled up when the kernel multiplexed them, and the time
+void readCounters(const PhaseProfile* p, double* values) {
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        uint64_t data[3];   // value, time enabled, time running
+        values[e] = 0.0;
+        if (p->fds[e] >= 0 && read(p->fds[e], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+            values[e] = (double)data[0] * ((double)data[1] / data[2]);
         }
-        if (!found) {    // if the thread comes with a new word 
-            ensureCapacity(dest);
-            strcpy(dest->words[dest->count].word, src->words[i].word);
-            dest->words[dest->count].count = src->words[i].count;
-            dest->count++;
+    }
+    values[NUM_EVENTS] = omp_get_wtime();
+}
+
+// Open the calling thread's counters; does nothing without --profile
+void startProfile(PhaseProfile* p) {
+    static const uint32_t types[NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    static const uint64_t configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,     // last-level cache misses on most CPUs
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+    memset(p, 0, sizeof(*p));
+    p->phase = PHASE_NONE;
+    if (!profiling) return;
+    p->enabled = 1;
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        p->fds[e] = openCounter(types[e], configs[e]);
+        if (p->fds[e] < 0 && !p->openErrno) p->openErrno = errno;
+    }
+    readCounters(p, p->last);
+}
+
+// Charge everything since the last switch to the current phase, then start charging phase
+void switchPhase(PhaseProfile* p, int phase) {
+    if (!p->enabled) return;
+    double now[NUM_EVENTS + 1];
+    readCounters(p, now);
+    if (p->phase != PHASE_NONE) {
+        for (int e = 0; e <= NUM_EVENTS; e++) p->totals[p->phase][e] += now[e] - p->last[e];
+    }
+    memcpy(p->last, now, sizeof(now));
+    p->phase = phase;
+}
+
+void stopProfile(PhaseProfile* p) {
+    if (!p->enabled) return;
+    switchPhase(p, PHASE_NONE);
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (p->fds[e] >= 0) close(p->fds[e]);
+    }
+}
+
+void initProfileReport(ProfileReport* r) {
+    memset(r, 0, sizeof(*r));
+    for (int e = 0; e < NUM_EVENTS; e++) r->available[e] = 1;
+}
+
+void addToReport(ProfileReport* r, const PhaseProfile* p) {
+    if (!p->enabled) return;
+    for (int ph = 0; ph < NUM_PHASES; ph++) {
+        for (int e = 0; e <= NUM_EVENTS; e++) r->totals[ph][e] += p->totals[ph][e];
+    }
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (p->fds[e] < 0) r->available[e] = 0;
+    }
+    if (!r->openErrno) r->openErrno = p->openErrno;
+    r->profiles++;
+}
+
+// Misses per thousand instructions, or n/a
+void printMpki(const ProfileReport* r, const double* row, int event) {
+    if (r->available[event] && r->available[EVENT_INSTRUCTIONS] && row[EVENT_INSTRUCTIONS] > 0.0) {
+        printf(" %11.3f", 1000.0 * row[event] / row[EVENT_INSTRUCTIONS]);
+    } else {
+        printf(" %11s", "n/a");
+    }
+}
+
+void printProfile(const ProfileReport* r) {
+    printf("\nPhase profile (summed over %d profiles", r->profiles);
+    int any = 0;
+    for (int e = 0; e < NUM_EVENTS; e++) any |= r->available[e];
+    if (!any) printf("; hardware counters unavailable: %s%s", strerror(r->openErrno),
+                     r->openErrno == EACCES || r->openErrno == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+    printf(")\n");
+    printf("%-12s %10s %12s %12s %6s %11s %11s %11s\n", "Phase", "Seconds", "Mcycles", "Minstr", "IPC",
+           "LLC MPKI", "Branch MPKI", "dTLB MPKI");
+    double sum[NUM_EVENTS + 1] = {0};
+    for (int ph = 0; ph <= NUM_PHASES; ph++) {
+        const double* row = ph < NUM_PHASES ? r->totals[ph] : sum;
+        if (ph < NUM_PHASES) {
+            if (row[NUM_EVENTS] <= 0.0) continue;
+            for (int e = 0; e <= NUM_EVENTS; e++) sum[e] += row[e];
+        }
+        printf("%-12s %10.6f", ph < NUM_PHASES ? phaseNames[ph] : "total", row[NUM_EVENTS]);
+        for (int e = EVENT_CYCLES; e <= EVENT_INSTRUCTIONS; e++) {
+            if (r->available[e]) printf(" %12.3f", row[e] / 1e6);
+            else printf(" %12s", "n/a");
+        }
+        if (r->available[EVENT_CYCLES] && r->available[EVENT_INSTRUCTIONS] && row[EVENT_CYCLES] > 0.0) {
+            printf(" %6.2f", row[EVENT_INSTRUCTIONS] / row[EVENT_CYCLES]);
+        } else {
+            printf(" %6s", "n/a");
         }
+        printMpki(r, row, EVENT_LLC_MISSES);
+        printMpki(r, row, EVENT_BRANCH_MISSES);
+        printMpki(r, row, EVENT_DTLB_MISSES);
+        printf("\n");
     }
 }
 
-int main() {
-    // Allocate initial allWords dynamic array
-    allWords = malloc(allWordsCapacity * sizeof(*allWords));
-    if (!allWords) {
-        fprintf(stderr, "Memory allocation failed for allWords\n");
-        return 1;
+// Pipeline engine (--pipeline): one reader thread cuts the input into
+// blocks, tokenizer threads clean and hash the words of whole blocks, and
+// each counter thread owns the words whose hash falls in its partition.
+// Stages hand work to each other through single-producer single-consumer
+// rings, one per pair of threads, and give spent buffers back through a
+// second ring, so nothing is allocated once the pipeline is full. No word
+// is ever counted in two tables, so there is no merge.
+typedef struct {
+    _Alignas(64) _Atomic size_t head;   // next slot to read, advanced by the consumer
+    _Alignas(64) _Atomic size_t tail;   // next slot to write, advanced by the producer
+    _Alignas(64) void* slots[RING_SIZE];
+} Ring;
+
+typedef struct {
+    size_t len;
+    int last;               // no blocks follow this one
+    char data[READ_BLOCK];
+} Block;
+
+// Cleaned words bound for one counter, with their hashes
+typedef struct {
+    int count;
+    int last;               // the tokenizer sends nothing after this batch
+    size_t poolUsed;
+    uint64_t hashes[TOKEN_BATCH];
+    uint32_t offsets[TOKEN_BATCH];
+    char pool[TOKEN_BATCH * 16];
+} TokenBatch;
+
+typedef struct {
+    const char* filename;
+    int tokenizers;
+    int counters;
+    int batchSize;          // ProbeBatch size of the counters
+    int failed;
+    Ring blocks[MAX_STAGE_THREADS];                             // reader -> tokenizer
+    Ring freeBlocks[MAX_STAGE_THREADS];                         // tokenizer -> reader
+    Ring batches[MAX_STAGE_THREADS][MAX_STAGE_THREADS];         // tokenizer -> counter
+    Ring freeBatches[MAX_STAGE_THREADS][MAX_STAGE_THREADS];     // counter -> tokenizer
+    int blocksAllocated[MAX_STAGE_THREADS];
+    int batchesAllocated[MAX_STAGE_THREADS][MAX_STAGE_THREADS];
+    long readerWaits;                       // reader found a tokenizer's ring full
+    long tokenizerWaits[MAX_STAGE_THREADS]; // tokenizer found no block to work on
+    long tokenizerStalls[MAX_STAGE_THREADS];// tokenizer found a counter's ring full
+    long counterWaits[MAX_STAGE_THREADS];   // counter found every input ring empty
+} Pipeline;
+
+Pipeline pipeline;
+WordList partitionLists[MAX_STAGE_THREADS];     //One dictionary partition per counter thread
+Arena counterArenas[MAX_STAGE_THREADS];
+PhaseProfile stageProfiles[1 + 2 * MAX_STAGE_THREADS];
+
+int ringPush(Ring* ring, void* item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == RING_SIZE) return 0;
+    ring->slots[tail & (RING_SIZE - 1)] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Next item of ring, or NULL if it is empty
+void* ringPop(Ring* ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) return NULL;
+    void* item = ring->slots[head & (RING_SIZE - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
+
+// Spin a little, then give the CPU to the other stages
+void waitTurn(int* spins) {
+    if (++*spins >= SPIN_LIMIT) {
+        sched_yield();
+        *spins = 0;
+    }
+}
+
+// Push item, waiting while the ring is full; counts one wait per full ring
+void ringPushWait(Ring* ring, void* item, long* waits) {
+    if (ringPush(ring, item)) return;
+    (*waits)++;
+    int spins = 0;
+    while (!ringPush(ring, item)) waitTurn(&spins);
+}
+
+void* ringPopWait(Ring* ring, long* waits) {
+    void* item = ringPop(ring);
+    if (item) return item;
+    (*waits)++;
+    int spins = 0;
+    while (!(item = ringPop(ring))) waitTurn(&spins);
+    return item;
+}
+
+// A spent buffer from the free ring, or a new one while fewer than
+// RING_SIZE exist; more never are, so the free ring cannot overflow
+void* takeBuffer(Ring* freeRing, int* allocated, size_t size, long* waits) {
+    void* buffer = ringPop(freeRing);
+    if (buffer) return buffer;
+    if (*allocated < RING_SIZE) {
+        buffer = malloc(size);
+        if (!buffer) {
+            fprintf(stderr, "Memory allocation failed for pipeline buffers\n");
+            exit(EXIT_FAILURE);
+        }
+        (*allocated)++;
+        return buffer;
     }
+    return ringPopWait(freeRing, waits);
+}
+
+void freeBuffers(Ring* freeRing, int allocated) {
+    for (int i = 0; i < allocated; i++) free(ringPop(freeRing));
+}
+
+// Counter that owns a word: the high half of the hash, scaled to the
+// counter count, so the low bits the slot index uses stay evenly spread
+int partitionOf(uint64_t hash, int counters) {
+    return (int)(((hash >> 32) * (uint64_t)counters) >> 32);
+}
 
-    FILE* file = fopen("input.txt", "r");
+// Read the input in blocks that end on whitespace, handing them to the
+// tokenizers in turn. A block with no whitespace at all is cut where it ends.
+void readerStage(Pipeline* p, PhaseProfile* profile) {
+    switchPhase(profile, PHASE_READ);
+    FILE* file = fopen(p->filename, "rb");
     if (!file) {
         perror("Error opening file");
-        free(allWords);
-        return 1;
+        p->failed = 1;
+    }
+    char* carry = malloc(READ_BLOCK);
+    size_t carried = 0;
+    int t = 0;
+    int done = !file || !carry;
+    if (file && !carry) {
+        fprintf(stderr, "Memory allocation failed for the reader\n");
+        p->failed = 1;
     }
+    while (!done) {
+        Block* block = takeBuffer(&p->freeBlocks[t], &p->blocksAllocated[t], sizeof(Block), &p->readerWaits);
+        memcpy(block->data, carry, carried);
+        size_t len = carried + fread(block->data + carried, 1, READ_BLOCK - carried, file);
+        done = len < READ_BLOCK;
+        size_t cut = len;
+        if (!done) {
+            while (cut > 0 && !isspace((unsigned char)block->data[cut - 1])) cut--;
+            if (cut == 0) cut = len;
+        }
+        carried = len - cut;
+        memcpy(carry, block->data + cut, carried);
+        block->len = cut;
+        block->last = 0;
+        ringPushWait(&p->blocks[t], block, &p->readerWaits);
+        t = (t + 1) % p->tokenizers;
+    }
+    if (file) {
+        if (ferror(file)) {
+            fprintf(stderr, "Failed to read %s\n", p->filename);
+            p->failed = 1;
+        }
+        fclose(file);
+    }
+    free(carry);
+    // Tell every tokenizer the input is over
+    for (int i = 0; i < p->tokenizers; i++) {
+        Block* block = takeBuffer(&p->freeBlocks[i], &p->blocksAllocated[i], sizeof(Block), &p->readerWaits);
+        block->len = 0;
+        block->last = 1;
+        ringPushWait(&p->blocks[i], block, &p->readerWaits);
+    }
+}
+
+TokenBatch* takeBatch(Pipeline* p, int t, int c) {
+    TokenBatch* batch = takeBuffer(&p->freeBatches[t][c], &p->batchesAllocated[t][c], sizeof(TokenBatch),
+                                   &p->tokenizerStalls[t]);
+    batch->count = 0;
+    batch->last = 0;
+    batch->poolUsed = 0;
+    return batch;
+}
 
+// Split blocks into cleaned words exactly like tokenizeBuffer and route
+// each word, with its hash, to the counter that owns it
+void tokenizerStage(Pipeline* p, int t, PhaseProfile* profile) {
+    TokenBatch* out[MAX_STAGE_THREADS];
+    for (int c = 0; c < p->counters; c++) out[c] = takeBatch(p, t, c);
     char tempWord[MAX_WORD_LEN];
+    for (;;) {
+        switchPhase(profile, PHASE_NONE);
+        Block* block = ringPopWait(&p->blocks[t], &p->tokenizerWaits[t]);
+        switchPhase(profile, PHASE_TOKENIZE);
+        int last = block->last;
+        size_t pos = 0;
+        while (pos < block->len) {
+            while (pos < block->len && isspace((unsigned char)block->data[pos])) pos++;
+            if (pos == block->len) break;
+            int len = 0;
+            while (pos < block->len && len < MAX_WORD_LEN - 1 && !isspace((unsigned char)block->data[pos])) {
+                tempWord[len++] = block->data[pos++];
+            }
+            tempWord[len] = '\0';
+            cleanWord(tempWord);
+            if (tempWord[0] == '\0') continue;
+            uint64_t hash = hashWord(tempWord);
+            int c = partitionOf(hash, p->counters);
+            TokenBatch* batch = out[c];
+            size_t wordLen = strlen(tempWord) + 1;
+            if (batch->count == TOKEN_BATCH || batch->poolUsed + wordLen > sizeof(batch->pool)) {
+                ringPushWait(&p->batches[t][c], batch, &p->tokenizerStalls[t]);
+                batch = out[c] = takeBatch(p, t, c);
+            }
+            batch->hashes[batch->count] = hash;
+            batch->offsets[batch->count] = (uint32_t)batch->poolUsed;
+            memcpy(batch->pool + batch->poolUsed, tempWord, wordLen);
+            batch->poolUsed += wordLen;
+            batch->count++;
+        }
+        // The reader only waits on this ring once RING_SIZE blocks are out, so it never overflows
+        ringPush(&p->freeBlocks[t], block);
+        if (last) break;
+    }
+    for (int c = 0; c < p->counters; c++) {
+        out[c]->last = 1;
+        ringPushWait(&p->batches[t][c], out[c], &p->tokenizerStalls[t]);
+    }
+}
 
-    // Read and clean words from input file, dynamically growing allWords array
-    while (fscanf(file, "%99s", tempWord) == 1) {
-        cleanWord(tempWord);
-        if (strlen(tempWord) > 0) {
-            if (totalWords >= allWordsCapacity) {
-                int newCapacity = allWordsCapacity * 2;
-                char (*newAllWords)[MAX_WORD_LEN] = realloc(allWords, newCapacity * sizeof(*allWords));
-                if (!newAllWords) {
-                    fprintf(stderr, "Memory reallocation failed for allWords\n");
-                    free(allWords);
-                    fclose(file);
-                    return 1;
+// Count the words of partition c as they arrive from any tokenizer
+void counterStage(Pipeline* p, int c, PhaseProfile* profile) {
+    WordList* list = &partitionLists[c];
+    ProbeBatch probeBatch;
+    initProbeBatch(&probeBatch, p->batchSize);
+    int finished[MAX_STAGE_THREADS] = {0};
+    int open = p->tokenizers;
+    int spins = 0;
+    switchPhase(profile, PHASE_COUNT);
+    while (open > 0) {
+        int got = 0;
+        for (int t = 0; t < p->tokenizers; t++) {
+            if (finished[t]) continue;
+            TokenBatch* batch = ringPop(&p->batches[t][c]);
+            if (!batch) continue;
+            got = 1;
+            if (p->batchSize > 1) {
+                for (int i = 0; i < batch->count; i++) {
+                    queueProbe(&probeBatch, list, batch->pool + batch->offsets[i], batch->hashes[i]);
+                }
+                drainProbeBatch(&probeBatch, list);   // the words live in the batch
+            } else {
+                for (int i = 0; i < batch->count; i++) {
+                    addWordWithHash(list, batch->pool + batch->offsets[i], batch->hashes[i], 1);
                 }
-                allWords = newAllWords;
-                allWordsCapacity = newCapacity;
             }
-            strcpy(allWords[totalWords++], tempWord);
+            if (batch->last) {
+                finished[t] = 1;
+                open--;
+            }
+            ringPush(&p->freeBatches[t][c], batch);
+        }
+        if (!got) {
+            p->counterWaits[c]++;
+            waitTurn(&spins);
         }
     }
+}
+
+// Append the words of a partition to dest. Partitions hold disjoint words,
+// so the columns and keys are copied in bulk and only the index is filled;
+// no key is compared.
+void appendPartition(WordList* dest, const WordList* src) {
+    while (dest->capacity < dest->count + src->count || dest->keyPoolUsed + src->keyPoolUsed > dest->keyPoolCapacity) {
+        ensureCapacity(dest, src->keyPoolUsed);
+    }
+    while ((dest->count + src->count) * 2 >= dest->slotCapacity) growSlots(dest);
+    int mask = dest->slotCapacity - 1;
+    for (int i = 0; i < src->count; i++) {
+        int d = dest->count + i;
+        dest->hashes[d] = src->hashes[i];
+        dest->keyOffsets[d] = dest->keyPoolUsed + src->keyOffsets[i];
+        dest->counts[d] = src->counts[i];
+        int s = (int)(src->hashes[i] & mask);
+        while (dest->slots[s] != -1) s = (s + 1) & mask;
+        dest->slots[s] = d;
+    }
+    memcpy(dest->keyPool + dest->keyPoolUsed, src->keyPool, src->keyPoolUsed);
+    dest->keyPoolUsed += src->keyPoolUsed;
+    dest->count += src->count;
+}
+
+// Count filename through the pipeline into globalWordList; returns -1 on failure
+int runPipeline(const char* filename, int tokenizers, int counters, int batchSize) {
+    Pipeline* p = &pipeline;
+    memset(p, 0, sizeof(*p));
+    p->filename = filename;
+    p->tokenizers = tokenizers;
+    p->counters = counters;
+    p->batchSize = batchSize;
+
+    // Size each partition for twice its even share of the words the file can hold
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror("Error opening file");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
     fclose(file);
+    size_t maxWords = (length > 0 ? (size_t)length : 0) / 2 + 1;
+    for (int c = 0; c < counters; c++) {
+        initArena(&counterArenas[c]);
+        initWordList(&partitionLists[c], &counterArenas[c], maxWords * 2 / counters, (length + maxWords) * 2 / counters);
+    }
 
-    // Initialize thread local WordLists
-    for (int i = 0; i < NUM_THREADS; i++) {
-        initWordList(&threadWordLists[i], 1000);
+    int threads = 1 + tokenizers + counters;
+    omp_set_dynamic(0);
+    #pragma omp parallel num_threads(threads)
+    {
+        // Every stage waits on the others, so all of them must be running
+        if (omp_get_num_threads() == threads) {
+            int tid = omp_get_thread_num();
+            startProfile(&stageProfiles[tid]);
+            if (tid == 0) {
+                readerStage(p, &stageProfiles[tid]);
+            } else if (tid <= tokenizers) {
+                tokenizerStage(p, tid - 1, &stageProfiles[tid]);
+            } else {
+                counterStage(p, tid - 1 - tokenizers, &stageProfiles[tid]);
+            }
+            stopProfile(&stageProfiles[tid]);
+        } else {
+            #pragma omp single
+            {
+                fprintf(stderr, "Pipeline needs %d threads, got %d\n", threads, omp_get_num_threads());
+                p->failed = 1;
+            }
+        }
     }
 
-    // Initialize global WordList
-    initWordList(&globalWordList, 2000);
+    for (int t = 0; t < tokenizers; t++) {
+        freeBuffers(&p->freeBlocks[t], p->blocksAllocated[t]);
+        for (int c = 0; c < counters; c++) freeBuffers(&p->freeBatches[t][c], p->batchesAllocated[t][c]);
+    }
+    if (p->failed) return -1;
 
-    double start = omp_get_wtime();
+    switchPhase(&mainProfile, PHASE_MERGE);
+    size_t words = 0, keyBytes = 0;
+    for (int c = 0; c < counters; c++) {
+        words += partitionLists[c].count;
+        keyBytes += partitionLists[c].keyPoolUsed;
+    }
+    initWordList(&globalWordList, &mainArena, words, keyBytes);
+    for (int c = 0; c < counters; c++) appendPartition(&globalWordList, &partitionLists[c]);
+    return 0;
+}
 
-    omp_set_num_threads(NUM_THREADS);
+void printPipelineStats(const Pipeline* p) {
+    long tokenizerWaits = 0, tokenizerStalls = 0, counterWaits = 0;
+    for (int t = 0; t < p->tokenizers; t++) {
+        tokenizerWaits += p->tokenizerWaits[t];
+        tokenizerStalls += p->tokenizerStalls[t];
+    }
+    for (int c = 0; c < p->counters; c++) counterWaits += p->counterWaits[c];
+    printf("Pipeline: 1 reader, %d tokenizers, %d counters; waits: reader %ld, tokenizers %ld for input "
+           "and %ld for counters, counters %ld idle polls\n",
+           p->tokenizers, p->counters, p->readerWaits, tokenizerWaits, tokenizerStalls, counterWaits);
+    for (int c = 0; c < p->counters; c++) {
+        printf("  partition %d: %d words\n", c, partitionLists[c].count);
+    }
+}
 
-    // Parallel word counting
-    #pragma omp parallel
-    {
-        int tid = omp_get_thread_num();
-        WordList* localList = &threadWordLists[tid]; //threadWordLists[tid] is each thread's local word counter
-        localList->count = 0;
+// Binary result file: a ResultHeader, the count column, count + 1 key offsets
+// and the key blob, sorted by key so readers can mmap the file and
+// binary-search it without parsing. Key i is the NUL-terminated string at
+// offsets[i] in the blob.
+typedef struct {
+    char magic[4];          // "WCB1"
+    uint32_t version;
+    uint64_t count;         // number of words
+    uint64_t keyBytes;      // size of the key blob
+    uint64_t totalTokens;   // sum of all counts
+} ResultHeader;
+
+// Background writer; takes ownership of the final WordList and frees it
+typedef struct {
+    WordList list;
+    const char* filename;
+    int failed;
+} ResultWriter;
+
+const WordList* sortList = NULL;   // list being ordered by compareKeys
+
+int compareKeys(const void* a, const void* b) {
+    return strcmp(getWord(sortList, *(const int*)a), getWord(sortList, *(const int*)b));
+}
+
+void* writeResultFile(void* arg) {
+    ResultWriter* writer = arg;
+    WordList* list = &writer->list;
+    int n = list->count;
+    int* order = malloc((n > 0 ? n : 1) * sizeof(int));
+    uint64_t* column = malloc(((size_t)n + 1) * sizeof(uint64_t));
+    FILE* file = fopen(writer->filename, "wb");
+    writer->failed = !order || !column || !file;
+
+    if (!writer->failed) {
+        for (int i = 0; i < n; i++) order[i] = i;
+        sortList = list;
+        qsort(order, n, sizeof(int), compareKeys);
+
+        ResultHeader header = { {'W', 'C', 'B', '1'}, 1, (uint64_t)n, list->keyPoolUsed, 0 };
+        for (int i = 0; i < n; i++) header.totalTokens += list->counts[i];
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (int i = 0; i < n; i++) column[i] = list->counts[order[i]];
+        fwrite(column, sizeof(uint64_t), n, file);
 
-        #pragma omp for schedule(static)     //divide the loop iterations evenly among threads
-        for (int i = 0; i < totalWords; i++) {
-            addWordToList(localList, allWords[i]);
+        uint64_t offset = 0;
+        for (int i = 0; i < n; i++) {
+            column[i] = offset;
+            offset += strlen(getWord(list, order[i])) + 1;
         }
+        column[n] = offset;
+        fwrite(column, sizeof(uint64_t), (size_t)n + 1, file);
+
+        for (int i = 0; i < n; i++) {
+            const char* word = getWord(list, order[i]);
+            fwrite(word, 1, strlen(word) + 1, file);
+        }
+        writer->failed = ferror(file) != 0;
     }
+    if (file && fclose(file) != 0) writer->failed = 1;
+    free(order);
+    free(column);
+    freeWordList(list);
+    return NULL;
+}
 
-    // Merge thread local lists into the global list 
-    for (int i = 0; i < NUM_THREADS; i++) {
-        mergeWordLists(&globalWordList, &threadWordLists[i]);
+// word_counter_bench.c includes this file with WORD_COUNTER_NO_MAIN to time the kernels
+#ifndef WORD_COUNTER_NO_MAIN
+int main(int argc, char** argv) {
+    int hotCacheSlots = DEFAULT_HOT_CACHE_SLOTS;
+    double sampleRate = 1.0;
+    int textOutput = 0;     // --text also prints the counts and saves them as text
+    int batchSize = DEFAULT_PROBE_BATCH;    // --batch=N probes N words at a time, 1 disables batching
+    int usePipeline = 0;    // --pipeline counts through reader, tokenizer and counter stages
+    int tokenizers = DEFAULT_TOKENIZERS;
+    int counters = DEFAULT_COUNTERS;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--hot-cache=", 12) == 0) {
+            hotCacheSlots = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sampleRate = atof(argv[i] + 9);
+        } else if (strcmp(argv[i], "--text") == 0) {
+            textOutput = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profiling = 1;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batchSize = atoi(argv[i] + 8);
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            usePipeline = 1;
+        } else if (strncmp(argv[i], "--tokenizers=", 13) == 0) {
+            tokenizers = atoi(argv[i] + 13);
+        } else if (strncmp(argv[i], "--counters=", 11) == 0) {
+            counters = atoi(argv[i] + 11);
+        } else {
+            fprintf(stderr, "Usage: %s [--hot-cache=SLOTS] [--sample=RATE] [--batch=N] [--text] [--profile]\n"
+                            "       [--pipeline [--tokenizers=N] [--counters=M]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (batchSize < 1 || batchSize > MAX_PROBE_BATCH) {
+        fprintf(stderr, "Batch size must be between 1 and %d\n", MAX_PROBE_BATCH);
+        return 1;
+    }
+    if (sampleRate <= 0.0 || sampleRate > 1.0) {
+        fprintf(stderr, "Sample rate must be in (0, 1]\n");
+        return 1;
     }
+    int approximate = sampleRate < 1.0;
+    if (tokenizers < 1 || tokenizers > MAX_STAGE_THREADS || counters < 1 || counters > MAX_STAGE_THREADS) {
+        fprintf(stderr, "Tokenizers and counters must be between 1 and %d\n", MAX_STAGE_THREADS);
+        return 1;
+    }
+    if (usePipeline && approximate) {
+        fprintf(stderr, "--pipeline counts every word and does not support --sample\n");
+        return 1;
+    }
+    if (usePipeline) hotCacheSlots = 0;    // counters already own their words
 
-    double end = omp_get_wtime();
+    double start, end;
+    double hllTime = 0.0;   // time of the full-input HyperLogLog pass in approximate mode
+    size_t inputSize = 0;
+    if (usePipeline) {
+        // Reading and tokenizing are pipeline stages, so they are timed too
+        initArena(&mainArena);
+        startProfile(&mainProfile);
+        start = omp_get_wtime();
+        if (runPipeline("input.txt", tokenizers, counters, batchSize) < 0) return 1;
+        stopProfile(&mainProfile);
+        end = omp_get_wtime();
+    } else {
+        // Allocate initial allWords dynamic array
+        allWords = malloc(allWordsCapacity * sizeof(*allWords));
+        if (!allWords) {
+            fprintf(stderr, "Memory allocation failed for allWords\n");
+            return 1;
+        }
 
-   
-    printf("Word Frequencies:\n");
-    for (int i = 0; i < globalWordList.count; i++) {
-        printf("%s: %d\n", globalWordList.words[i].word, globalWordList.words[i].count);
+        startProfile(&mainProfile);
+        switchPhase(&mainProfile, PHASE_READ);
+        char* input = readFile("input.txt", &inputSize);
+        if (!input) {
+            free(allWords);
+            return 1;
+        }
+
+        // Clean words from the sampled part of the input, dynamically growing allWords array
+        switchPhase(&mainProfile, PHASE_TOKENIZE);
+        if (tokenizeBuffer(input, inputSize, sampleRate, &allWords, &totalWords, &allWordsCapacity) < 0) {
+            free(input);
+            free(allWords);
+            return 1;
+        }
+        switchPhase(&mainProfile, PHASE_NONE);
+
+        // Initialize thread local WordLists, sized for the words each thread gets.
+        // A list never holds more words than it sees tokens, nor more key bytes
+        // than the input plus one terminator per token.
+        size_t threadWords = ((size_t)totalWords + NUM_THREADS - 1) / NUM_THREADS;
+        size_t maxKeyBytes = inputSize + totalWords;
+        size_t threadKeyBytes = threadWords * MAX_WORD_LEN < maxKeyBytes ? threadWords * MAX_WORD_LEN : maxKeyBytes;
+        for (int i = 0; i < NUM_THREADS; i++) {
+            initArena(&threadArenas[i]);
+            initWordList(&threadWordLists[i], &threadArenas[i], threadWords, threadKeyBytes);
+            initHotCache(&threadHotCaches[i], hotCacheSlots);
+        }
+        initArena(&mainArena);
+
+        start = omp_get_wtime();
+
+        omp_set_num_threads(NUM_THREADS);
+
+        // HyperLogLog over all of the input, each thread scanning one byte range
+        if (approximate) {
+            switchPhase(&mainProfile, PHASE_TOKENIZE);
+            #pragma omp parallel
+            {
+                int tid = omp_get_thread_num();
+                int threads = omp_get_num_threads();
+                hllScan(threadHll[tid], input, inputSize, inputSize * tid / threads, inputSize * (tid + 1) / threads);
+            }
+            switchPhase(&mainProfile, PHASE_NONE);
+            hllTime = omp_get_wtime() - start;
+        }
+        free(input);
+
+        // Parallel word counting
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+            WordList* localList = &threadWordLists[tid]; //threadWordLists[tid] is each thread's local word counter
+            HotCache* hotCache = &threadHotCaches[tid];
+            ProbeBatch probeBatch;
+            initProbeBatch(&probeBatch, batchSize);
+            ProbeBatch* batch = batchSize > 1 ? &probeBatch : NULL;
+            startProfile(&threadProfiles[tid]);
+            switchPhase(&threadProfiles[tid], PHASE_COUNT);
+
+            #pragma omp for schedule(static)     //divide the words evenly among threads
+            for (int i = 0; i < totalWords; i++) {
+                addWordCached(hotCache, batch, localList, allWords[i]);
+            }
+            if (batch) drainProbeBatch(batch, localList);
+            flushHotCache(hotCache, localList);
+            stopProfile(&threadProfiles[tid]);
+        }
+
+        // Merge thread local lists into the global list, sized to hold all of them
+        switchPhase(&mainProfile, PHASE_MERGE);
+        size_t mergedWords = 0, mergedKeyBytes = 0;
+        for (int i = 0; i < NUM_THREADS; i++) {
+            mergedWords += threadWordLists[i].count;
+            mergedKeyBytes += threadWordLists[i].keyPoolUsed;
+        }
+        initWordList(&globalWordList, &mainArena, mergedWords, mergedKeyBytes);
+        for (int i = 0; i < NUM_THREADS; i++) {
+            mergeWordLists(&globalWordList, &threadWordLists[i]);
+        }
+
+        scaleCounts(&globalWordList, sampleRate);
+        stopProfile(&mainProfile);
+
+        end = omp_get_wtime();
+    }
+
+    if (textOutput) {
+        printf("Word Frequencies:\n");
+        for (int i = 0; i < globalWordList.count; i++) {
+            printf("%s: %llu\n", getWord(&globalWordList, i), (unsigned long long)globalWordList.counts[i]);
+        }
     }
 
+    printf("Unique words: %d\n", globalWordList.count);
     printf("Execution time: %f seconds\n", end - start);
 
+    if (approximate) {
+        for (int t = 1; t < NUM_THREADS; t++) {
+            for (int r = 0; r < (1 << HLL_BITS); r++) {
+                if (threadHll[t][r] > threadHll[0][r]) threadHll[0][r] = threadHll[t][r];
+            }
+        }
+        printf("Sample rate: %g (counts scaled by %g)\n", sampleRate, 1.0 / sampleRate);
+        printf("Estimated distinct words (HyperLogLog): %.0f, sampled distinct words: %d\n",
+               hllEstimate(threadHll[0]), globalWordList.count);
+        printf("HyperLogLog pass over all %zu input bytes: %f seconds of the execution time\n",
+               inputSize, hllTime);
+    }
+
+    if (hotCacheSlots > 0) {
+        long long hits = 0, misses = 0, flushes = 0;
+        for (int i = 0; i < NUM_THREADS; i++) {
+            hits += threadHotCaches[i].hits;
+            misses += threadHotCaches[i].misses;
+            flushes += threadHotCaches[i].flushes;
+        }
+        printf("Hot cache: %d slots/thread, hit rate %.2f%% (%lld hits, %lld misses, %lld flushes)\n",
+               threadHotCaches[0].mask + 1, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+               hits, misses, flushes);
+    }
+
+    // Every list is still alive here, so syncing them captures the peak
+    Arena arenaTotal;
+    initArena(&arenaTotal);
+    syncArenaUsage(&globalWordList, 0);
+    addArenaStats(&arenaTotal, &mainArena);
+    if (usePipeline) {
+        for (int c = 0; c < counters; c++) {
+            syncArenaUsage(&partitionLists[c], 0);
+            addArenaStats(&arenaTotal, &counterArenas[c]);
+        }
+        printArenaStats(&arenaTotal, counters + 1);
+        printPipelineStats(&pipeline);
+    } else {
+        for (int i = 0; i < NUM_THREADS; i++) {
+            syncArenaUsage(&threadWordLists[i], 0);
+            addArenaStats(&arenaTotal, &threadArenas[i]);
+        }
+        printArenaStats(&arenaTotal, NUM_THREADS + 1);
+    }
+
+    if (profiling) {
+        ProfileReport report;
+        initProfileReport(&report);
+        addToReport(&report, &mainProfile);
+        for (int i = 0; i < NUM_THREADS; i++) addToReport(&report, &threadProfiles[i]);
+        for (int i = 0; i < 1 + 2 * MAX_STAGE_THREADS; i++) addToReport(&report, &stageProfiles[i]);
+        printProfile(&report);
+    }
 
     // Save the printed output to a file
+    if (textOutput) {
 FILE *outputFile = fopen("word_frequencies._output_openmp.txt", "w");
 if (outputFile != NULL) {
     fprintf(outputFile, "Word Frequencies:\n");
     for (int i = 0; i < globalWordList.count; i++) {
-        fprintf(outputFile, "%s: %d\n", globalWordList.words[i].word, globalWordList.words[i].count);
+        fprintf(outputFile, "%s: %llu\n", getWord(&globalWordList, i), (unsigned long long)globalWordList.counts[i]);
     }
     fclose(outputFile);
-    printf("Output also saved to 'word_frequencies.txt'\n");
+    printf("Output also saved to 'word_frequencies._output_openmp.txt'\n");
 } else {
     perror("Error opening file for writing");
 }
+    }
 
+    // The binary result is written in the background while everything else is freed
+    ResultWriter writer = { globalWordList, "word_frequencies_openmp.wcb", 0 };
+    pthread_t writerThread;
+    int writerStarted = pthread_create(&writerThread, NULL, writeResultFile, &writer) == 0;
+    if (!writerStarted) writeResultFile(&writer);
 
     for (int i = 0; i < NUM_THREADS; i++) {
         freeWordList(&threadWordLists[i]);
     }
-    freeWordList(&globalWordList);
+    for (int c = 0; c < MAX_STAGE_THREADS; c++) {
+        freeWordList(&partitionLists[c]);
+    }
     free(allWords);
 
+    if (writerStarted) pthread_join(writerThread, NULL);
+    if (writer.failed) {
+        perror("Error writing word_frequencies_openmp.wcb");
+        return 1;
+    }
+    printf("Results saved to 'word_frequencies_openmp.wcb'\n");
+
     return 0;
 }
+#endif
@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <omp.h>
+
+// Sliding-window word counts over an unbounded stream on stdin:
+//
+//   tail -F app.log | ./word_counter_stream --window-seconds=600 --interval=10
+//   ./word_counter_stream --window-tokens=1000000 --buckets=100 < feed.txt
+//
+// The window is a ring of buckets. Words counted while a bucket is open go
+// into the bucket and into the window totals; when the bucket falls out of
+// the window its counts are subtracted again, so keeping the window current
+// costs the same however long it is. The window covers the open bucket and
+// the numBuckets - 1 before it; --buckets=1 gives tumbling windows.
+
+#define MAX_WORD_LEN 100
+#define MAX_THREADS 64
+#define NUM_THREADS 4
+#define DEFAULT_BUCKETS 60
+#define DEFAULT_WINDOW_SECONDS 300.0
+#define DEFAULT_INTERVAL 10.0
+#define DEFAULT_TOP 10
+#define READ_CHUNK (1 << 20)
+#define PARALLEL_MIN_BYTES 65536    // smaller batches are tokenized by one thread
+#define COMPACT_MIN_ZEROS 4096      // expired entries tolerated before a rebuild
+
+// Structure-of-arrays dictionary, as in the counters
+typedef struct {
+    uint64_t* hashes;       // hash of each word
+    size_t* keyOffsets;     // offset of each word in keyPool
+    uint64_t* counts;       // occurrences of each word
+    int count;              // number of unique words
+    int capacity;           // current capacity of the columns
+    char* keyPool;          // NUL-terminated words stored back to back
+    size_t keyPoolUsed;
+    size_t keyPoolCapacity;
+    int* slots;             // open-addressing index into the columns, -1 if empty
+    int slotCapacity;       // always a power of two
+} WordList;
+
+typedef struct {
+    WordList list;          // words counted while the bucket was open
+    uint64_t tokens;
+} Bucket;
+
+// Counts over the live buckets. Words whose occurrences all expired keep
+// their entry with a zero count until enough pile up to be worth a rebuild.
+typedef struct {
+    WordList counts;
+    uint64_t tokens;
+    int zeros;              // entries with a zero count
+    Bucket* buckets;        // ring; buckets[open % numBuckets] takes new words
+    int numBuckets;
+    long long open;         // sequence number of the open bucket
+} Window;
+
+int numThreads = NUM_THREADS;
+WordList threadLists[MAX_THREADS];      // words of the current batch, one list per thread
+uint64_t threadTokens[MAX_THREADS];
+
+double windowSeconds = DEFAULT_WINDOW_SECONDS;
+uint64_t windowTokens = 0;      // nonzero for a window of the last N tokens
+double bucketSeconds;
+uint64_t bucketTokens;
+
+volatile sig_atomic_t running = 1;
+
+void handleSignal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Clean word by removing punctuation and converting to lowercase
+void cleanWord(char* word) {
+    int i, j = 0;
+    char temp[MAX_WORD_LEN];
+    for (i = 0; word[i] != '\0'; i++) {
+        if (isalpha((unsigned char)word[i])) {
+            temp[j++] = tolower((unsigned char)word[i]);
+        }
+    }
+    temp[j] = '\0';
+    strcpy(word, temp);
+}
+
+// FNV-1a hash of a cleaned word
+uint64_t hashWord(const char* word) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *word; word++) {
+        h ^= (unsigned char)*word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void initWordList(WordList* list, int capacity) {
+    list->hashes = malloc(capacity * sizeof(uint64_t));
+    list->keyOffsets = malloc(capacity * sizeof(size_t));
+    list->counts = malloc(capacity * sizeof(uint64_t));
+    list->keyPoolCapacity = (size_t)capacity * 8;
+    list->keyPool = malloc(list->keyPoolCapacity);
+    list->slotCapacity = 1;
+    while (list->slotCapacity < capacity * 2) list->slotCapacity <<= 1;
+    list->slots = malloc(list->slotCapacity * sizeof(int));
+    if (!list->hashes || !list->keyOffsets || !list->counts || !list->keyPool || !list->slots) {
+        fprintf(stderr, "Memory allocation failed for WordList\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(list->slots, -1, list->slotCapacity * sizeof(int));
+    list->count = 0;
+    list->capacity = capacity;
+    list->keyPoolUsed = 0;
+}
+
+// Free WordList memory
+void freeWordList(WordList* list) {
+    free(list->hashes);
+    free(list->keyOffsets);
+    free(list->counts);
+    free(list->keyPool);
+    free(list->slots);
+    memset(list, 0, sizeof(*list));
+}
+
+// Empty a WordList but keep its memory for reuse
+void clearWordList(WordList* list) {
+    memset(list->slots, -1, list->slotCapacity * sizeof(int));
+    list->count = 0;
+    list->keyPoolUsed = 0;
+}
+
+// Word stored at index i of a WordList
+const char* getWord(const WordList* list, int i) {
+    return list->keyPool + list->keyOffsets[i];
+}
+
+// Rebuild the index at twice the size from the stored hashes
+void growSlots(WordList* list) {
+    int newSlotCapacity = list->slotCapacity * 2;
+    int* newSlots = malloc(newSlotCapacity * sizeof(int));
+    if (!newSlots) {
+        fprintf(stderr, "Memory reallocation failed\n");
+        freeWordList(list);
+        exit(EXIT_FAILURE);
+    }
+    memset(newSlots, -1, newSlotCapacity * sizeof(int));
+    for (int i = 0; i < list->count; i++) {
+        int s = (int)(list->hashes[i] & (newSlotCapacity - 1));
+        while (newSlots[s] != -1) s = (s + 1) & (newSlotCapacity - 1);
+        newSlots[s] = i;
+    }
+    free(list->slots);
+    list->slots = newSlots;
+    list->slotCapacity = newSlotCapacity;
+}
+
+// Make room for one more word of length wordLen in WordList
+void ensureCapacity(WordList* list, size_t wordLen) {
+    if (list->count >= list->capacity) {
+        int newCapacity = list->capacity * 2;
+        uint64_t* newHashes = realloc(list->hashes, newCapacity * sizeof(uint64_t));
+        if (newHashes) list->hashes = newHashes;
+        size_t* newOffsets = realloc(list->keyOffsets, newCapacity * sizeof(size_t));
+        if (newOffsets) list->keyOffsets = newOffsets;
+        uint64_t* newCounts = realloc(list->counts, newCapacity * sizeof(uint64_t));
+        if (newCounts) list->counts = newCounts;
+        if (!newHashes || !newOffsets || !newCounts) {
+            fprintf(stderr, "Memory reallocation failed\n");
+            freeWordList(list);
+            exit(EXIT_FAILURE);
+        }
+        list->capacity = newCapacity;
+    }
+    if (list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity) {
+        size_t newPoolCapacity = list->keyPoolCapacity * 2 + wordLen + 1;
+        char* newPool = realloc(list->keyPool, newPoolCapacity);
+        if (!newPool) {
+            fprintf(stderr, "Memory reallocation failed\n");
+            freeWordList(list);
+            exit(EXIT_FAILURE);
+        }
+        list->keyPool = newPool;
+        list->keyPoolCapacity = newPoolCapacity;
+    }
+    if (list->count * 2 >= list->slotCapacity) {
+        growSlots(list);
+    }
+}
+
+// Return the index of a word with a precomputed hash in list, or -1 if absent
+int findWordWithHash(const WordList* list, const char* word, uint64_t hash) {
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) return i;
+        s = (s + 1) & mask;
+    }
+    return -1;
+}
+
+// Add word with a precomputed hash and a given count in a given WordList
+void addWordWithHash(WordList* list, const char* word, uint64_t hash, uint64_t count) {
+    int mask = list->slotCapacity - 1;
+    int s = (int)(hash & mask);
+    while (list->slots[s] != -1) {
+        int i = list->slots[s];
+        if (list->hashes[i] == hash && strcmp(getWord(list, i), word) == 0) {
+            list->counts[i] += count;  // if the word already exists in the list
+            return;
+        }
+        s = (s + 1) & mask;
+    }
+    // Add new word if not exists with the given count
+    size_t wordLen = strlen(word);
+    if (list->count >= list->capacity || list->keyPoolUsed + wordLen + 1 > list->keyPoolCapacity ||
+        list->count * 2 >= list->slotCapacity) {
+        ensureCapacity(list, wordLen);
+        mask = list->slotCapacity - 1;
+        s = (int)(hash & mask);
+        while (list->slots[s] != -1) s = (s + 1) & mask;
+    }
+    list->slots[s] = list->count;
+    list->hashes[list->count] = hash;
+    list->keyOffsets[list->count] = list->keyPoolUsed;
+    list->counts[list->count] = count;
+    memcpy(list->keyPool + list->keyPoolUsed, word, wordLen + 1);
+    list->keyPoolUsed += wordLen + 1;
+    list->count++;
+}
+
+// Split text on whitespace the way fscanf("%99s") does and count every
+// cleaned token; returns the number of tokens added
+uint64_t countText(WordList* list, const char* text, size_t len) {
+    uint64_t added = 0;
+    size_t i = 0;
+    char word[MAX_WORD_LEN];
+    while (i < len) {
+        while (i < len && isspace((unsigned char)text[i])) i++;
+        int j = 0;
+        while (i < len && !isspace((unsigned char)text[i]) && j < MAX_WORD_LEN - 1) {
+            word[j++] = text[i++];
+        }
+        if (j == 0) break;
+        word[j] = '\0';
+        cleanWord(word);
+        if (strlen(word) > 0) {
+            addWordWithHash(list, word, hashWord(word), 1);
+            added++;
+        }
+    }
+    return added;
+}
+
+void initWindow(Window* window, int numBuckets) {
+    initWordList(&window->counts, 4096);
+    window->tokens = 0;
+    window->zeros = 0;
+    window->numBuckets = numBuckets;
+    window->open = 0;
+    window->buckets = malloc(numBuckets * sizeof(Bucket));
+    if (!window->buckets) {
+        fprintf(stderr, "Memory allocation failed for window buckets\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int b = 0; b < numBuckets; b++) {
+        initWordList(&window->buckets[b].list, 1024);
+        window->buckets[b].tokens = 0;
+    }
+}
+
+void freeWindow(Window* window) {
+    for (int b = 0; b < window->numBuckets; b++) freeWordList(&window->buckets[b].list);
+    free(window->buckets);
+    freeWordList(&window->counts);
+}
+
+Bucket* openBucket(Window* window) {
+    return &window->buckets[window->open % window->numBuckets];
+}
+
+// Add a batch of counted words to the open bucket and the window totals
+void addToWindow(Window* window, const WordList* batch, uint64_t tokens) {
+    Bucket* bucket = openBucket(window);
+    for (int i = 0; i < batch->count; i++) {
+        const char* word = getWord(batch, i);
+        addWordWithHash(&bucket->list, word, batch->hashes[i], batch->counts[i]);
+        int w = findWordWithHash(&window->counts, word, batch->hashes[i]);
+        if (w == -1) {
+            addWordWithHash(&window->counts, word, batch->hashes[i], batch->counts[i]);
+        } else {
+            if (window->counts.counts[w] == 0) window->zeros--;
+            window->counts.counts[w] += batch->counts[i];
+        }
+    }
+    bucket->tokens += tokens;
+    window->tokens += tokens;
+}
+
+// Drop the words of one bucket from the window totals and empty it; this
+// costs the bucket's distinct words, not the window's
+void expireBucket(Window* window, Bucket* bucket) {
+    for (int i = 0; i < bucket->list.count; i++) {
+        int w = findWordWithHash(&window->counts, getWord(&bucket->list, i), bucket->list.hashes[i]);
+        window->counts.counts[w] -= bucket->list.counts[i];
+        if (window->counts.counts[w] == 0) window->zeros++;
+    }
+    window->tokens -= bucket->tokens;
+    clearWordList(&bucket->list);
+    bucket->tokens = 0;
+}
+
+// Rebuild the totals without expired words once they make up half the
+// table; each rebuild is paid for by the expiries that created the zeros
+void compactWindow(Window* window) {
+    if (window->zeros < COMPACT_MIN_ZEROS || window->zeros * 2 < window->counts.count) return;
+    WordList live;
+    int liveCount = window->counts.count - window->zeros;
+    initWordList(&live, liveCount > 1024 ? liveCount : 1024);
+    for (int i = 0; i < window->counts.count; i++) {
+        if (window->counts.counts[i] > 0) {
+            addWordWithHash(&live, getWord(&window->counts, i), window->counts.hashes[i], window->counts.counts[i]);
+        }
+    }
+    freeWordList(&window->counts);
+    window->counts = live;
+    window->zeros = 0;
+}
+
+// Open bucket number seq, expiring every bucket that leaves the window
+void advanceWindow(Window* window, long long seq) {
+    if (seq <= window->open) return;
+    // After a long idle gap every bucket has expired; skip the empty turns
+    if (seq - window->open > window->numBuckets) window->open = seq - window->numBuckets;
+    while (window->open < seq) {
+        window->open++;
+        expireBucket(window, openBucket(window));
+    }
+    compactWindow(window);
+}
+
+// Start of thread t's share of text; shares begin after whitespace so no
+// token is split between threads
+size_t sliceStart(const char* text, size_t len, int t, int n) {
+    if (t == 0) return 0;
+    size_t p = len * t / n;
+    while (p < len && !isspace((unsigned char)text[p - 1])) p++;
+    return p;
+}
+
+// Count a batch of whole tokens in parallel and add it to the window
+void countBatch(Window* window, const char* text, size_t len) {
+    #pragma omp parallel num_threads(numThreads) if (len >= PARALLEL_MIN_BYTES)
+    {
+        int t = omp_get_thread_num();
+        int n = omp_get_num_threads();
+        size_t first = sliceStart(text, len, t, n);
+        size_t last = sliceStart(text, len, t + 1, n);
+        threadTokens[t] = countText(&threadLists[t], text + first, last - first);
+    }
+    for (int t = 0; t < numThreads; t++) {
+        if (threadLists[t].count == 0) continue;
+        addToWindow(window, &threadLists[t], threadTokens[t]);
+        clearWordList(&threadLists[t]);
+        threadTokens[t] = 0;
+    }
+}
+
+// Count the complete tokens at the front of text and return the bytes used.
+// Unless final, a token running into the end of text waits for more input.
+// Token windows cut batches where the open bucket fills up: a batch ending
+// in whitespace holds at most one token per two bytes.
+size_t consumeText(Window* window, const char* text, size_t len, int final) {
+    size_t done = 0;
+    while (done < len) {
+        size_t rest = len - done;
+        size_t cut = rest;
+        if (bucketTokens > 0) {
+            uint64_t room = bucketTokens - openBucket(window)->tokens;
+            if (room * 2 < cut) cut = room * 2;
+        }
+        if (cut < rest || !final) {
+            size_t back = cut;
+            while (back > 0 && !isspace((unsigned char)text[done + back - 1])) back--;
+            if (back > 0) {
+                cut = back;
+            } else {
+                // One token longer than the cut; take it whole
+                while (cut < rest && !isspace((unsigned char)text[done + cut - 1])) cut++;
+                if (!isspace((unsigned char)text[done + cut - 1]) && !final) break;
+            }
+        }
+        countBatch(window, text + done, cut);
+        done += cut;
+        if (bucketTokens > 0 && openBucket(window)->tokens >= bucketTokens) {
+            advanceWindow(window, window->open + 1);
+        }
+    }
+    return done;
+}
+
+// Ranks word a below word b: fewer occurrences, or alphabetically later on a tie
+int ranksBelow(const WordList* list, int a, int b) {
+    if (list->counts[a] != list->counts[b]) return list->counts[a] < list->counts[b];
+    return strcmp(getWord(list, a), getWord(list, b)) > 0;
+}
+
+void siftDown(const WordList* list, int* heap, int n, int i) {
+    for (;;) {
+        int lowest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && ranksBelow(list, heap[l], heap[lowest])) lowest = l;
+        if (r < n && ranksBelow(list, heap[r], heap[lowest])) lowest = r;
+        if (lowest == i) return;
+        int tmp = heap[i];
+        heap[i] = heap[lowest];
+        heap[lowest] = tmp;
+        i = lowest;
+    }
+}
+
+// Indices of the k most frequent words in list, most frequent first; a
+// min-heap of k entries keeps this O(n log k) over the window's words
+int topWords(const WordList* list, int k, int* top) {
+    int n = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->counts[i] == 0) continue;
+        if (n < k) {
+            top[n++] = i;
+            if (n == k) {
+                for (int j = k / 2 - 1; j >= 0; j--) siftDown(list, top, k, j);
+            }
+        } else if (ranksBelow(list, top[0], i)) {
+            top[0] = i;
+            siftDown(list, top, k, 0);
+        }
+    }
+    if (n < k) {
+        for (int j = n / 2 - 1; j >= 0; j--) siftDown(list, top, n, j);
+    }
+    // Pop the lowest to the back until the heap is empty
+    for (int end = n - 1; end > 0; end--) {
+        int tmp = top[0];
+        top[0] = top[end];
+        top[end] = tmp;
+        siftDown(list, top, end, 0);
+    }
+    return n;
+}
+
+void printSnapshot(const Window* window, int topK, int* top, double elapsed) {
+    if (windowTokens > 0) {
+        printf("[%.1fs] last %llu tokens: %llu tokens, %d distinct words\n", elapsed,
+               (unsigned long long)windowTokens, (unsigned long long)window->tokens,
+               window->counts.count - window->zeros);
+    } else {
+        printf("[%.1fs] last %g s: %llu tokens, %d distinct words\n", elapsed, windowSeconds,
+               (unsigned long long)window->tokens, window->counts.count - window->zeros);
+    }
+    int n = topWords(&window->counts, topK, top);
+    for (int i = 0; i < n; i++) {
+        printf("%s: %llu\n", getWord(&window->counts, top[i]), (unsigned long long)window->counts.counts[top[i]]);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int numBuckets = DEFAULT_BUCKETS;
+    double interval = DEFAULT_INTERVAL;
+    int topK = DEFAULT_TOP;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--window-seconds=", 17) == 0) {
+            windowSeconds = atof(argv[i] + 17);
+            windowTokens = 0;
+        } else if (strncmp(argv[i], "--window-tokens=", 16) == 0) {
+            windowTokens = strtoull(argv[i] + 16, NULL, 10);
+        } else if (strncmp(argv[i], "--buckets=", 10) == 0) {
+            numBuckets = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--interval=", 11) == 0) {
+            interval = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--top=", 6) == 0) {
+            topK = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            numThreads = atoi(argv[i] + 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--window-seconds=S | --window-tokens=N] [--buckets=B] "
+                            "[--interval=S] [--top=K] [--threads=N] < stream\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numBuckets < 1 || interval <= 0.0 || topK < 1 || numThreads < 1 || numThreads > MAX_THREADS ||
+        (windowTokens == 0 && windowSeconds <= 0.0) || (windowTokens > 0 && windowTokens < (uint64_t)numBuckets)) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+    bucketTokens = windowTokens / numBuckets;
+    bucketSeconds = windowSeconds / numBuckets;
+
+    Window window;
+    initWindow(&window, numBuckets);
+    for (int t = 0; t < numThreads; t++) initWordList(&threadLists[t], 1024);
+    char* buffer = malloc(READ_CHUNK);
+    int* top = malloc(topK * sizeof(int));
+    if (!buffer || !top) {
+        fprintf(stderr, "Memory allocation failed for stream buffers\n");
+        return 1;
+    }
+
+    // No SA_RESTART, so a signal wakes poll and the final snapshot is printed
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    double start = nowSeconds();
+    double nextSnapshot = interval;
+    size_t used = 0;
+    int eof = 0;
+    while (running && !eof) {
+        double elapsed = nowSeconds() - start;
+        if (windowTokens == 0) advanceWindow(&window, (long long)(elapsed / bucketSeconds));
+        if (elapsed >= nextSnapshot) {
+            printSnapshot(&window, topK, top, elapsed);
+            while (nextSnapshot <= elapsed) nextSnapshot += interval;
+        }
+
+        // Sleep until input arrives, a snapshot is due or a time bucket closes
+        double wait = nextSnapshot - elapsed;
+        if (windowTokens == 0) {
+            double bucketEnd = ((long long)(elapsed / bucketSeconds) + 1) * bucketSeconds;
+            if (bucketEnd - elapsed < wait) wait = bucketEnd - elapsed;
+        }
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        int ready = poll(&pfd, 1, (int)(wait * 1000.0) + 1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (ready == 0) continue;
+
+        ssize_t n = read(STDIN_FILENO, buffer + used, READ_CHUNK - used);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("read");
+            break;
+        }
+        if (n == 0) eof = 1;
+        used += n;
+
+        // A full buffer without whitespace is cut as if the input ended there
+        size_t done = consumeText(&window, buffer, used, eof);
+        if (done == 0 && used == READ_CHUNK) done = consumeText(&window, buffer, used, 1);
+        memmove(buffer, buffer + done, used - done);
+        used -= done;
+    }
+
+    printSnapshot(&window, topK, top, nowSeconds() - start);
+
+    for (int t = 0; t < numThreads; t++) freeWordList(&threadLists[t]);
+    freeWindow(&window);
+    free(buffer);
+    free(top);
+    return 0;
+}